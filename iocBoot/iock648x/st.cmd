@@ -37,9 +37,28 @@ asynOctetConnect("serial1", "serial1")
 #drvAsynKeithley648x("6487", "CA1","serial1",-1);
 #dbLoadRecords("$(TOP)/k648xApp/Db/Keithley6487.db","P=k648x:,CA=CA1:,PORT=CA1"
 
+##### many instruments: share one I/O engine (scheduler plus 2 publishing
+##### workers) instead of two threads per port; call before the ports
+#drvAsynKeithley648xEngine(2)
+
 ##### for 6487
+# drvAsynKeithley648x(type,myport,ioport,ioaddr,baud) with baud > 0 moves
+# the instrument and serial1 to that rate (e.g. 57600) during init
 drvAsynKeithley648x("6485", "CA1","serial1",-1);
 dbLoadRecords("$(TOP)/k648xApp/Db/Keithley6485.db","P=k648x:,CA=CA1:,PORT=CA1"
+# with the acquisition thread running (acquireSet=On) the read record
+# can follow every reading instead of polling:
+#dbLoadRecords("$(TOP)/k648xApp/Db/Keithley6485.db","P=k648x:,CA=CA1:,PORT=CA1,READ_SCAN=I/O Intr")
+# and only follow it when it moves by 1 pA or 1%, at most 10 times a second
+#drvAsynKeithley648xDeadband("CA1","READ",1e-12,0.01,10)
+# the last 64 serial transactions print on the first I/O error, or with
+#drvAsynKeithley648xDump("CA1",0)
+# photodiode response (energy eV, responsivity A/W per line) for power and flux
+#drvAsynKeithley648xResponse("CA1","$(TOP)/iocBoot/$(IOC)/diode.txt")
+# after iocInit, with zero check on: fastest NPLC/filter below 100 fA rms
+#drvAsynKeithley648xTune("CA1",1e-13,20)
+# after iocInit: time per READ, serial line included
+#drvAsynKeithley648xBench("CA1","READ","Float64",100)
 
 ##### asyn record for debugging
 dbLoadRecords("$(ASYN)/db/asynRecord.db", "P=k648x:,R=asyn_k648x,PORT=serial1,ADDR=0,OMAX=256,IMAX=2048")
@@ -61,6 +80,12 @@ dbLoadRecords("$(ASYN)/db/asynRecord.db", "P=k648x:,R=asyn_k648x,PORT=serial1,AD
 ##### asyn record for debugging
 dbLoadRecords("$(ASYN)/db/asynRecord.db", "P=k648x:,R=asyn_k648x,PORT=ip_ca1,ADDR=0,OMAX=256,IMAX=2048")
 
+########### replay of a captured reading file ###################
+
+# drvAsynKeithley648x( "6485", "CA2","file:$(TOP)/iocBoot/$(IOC)/ca1.csv",0);
+# dbLoadRecords("$(TOP)/k648xApp/Db/Keithley6485.db","P=k648x:,CA=CA2:,PORT=CA2")
+# dbLoadRecords("$(TOP)/k648xApp/Db/Keithley648xReplay.db","P=k648x:,CA=CA2:,PORT=CA2")
+
 #####################################
 
 
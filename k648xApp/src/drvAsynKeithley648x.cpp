@@ -4,13 +4,240 @@
     initialize the driver, the method drvAsynKeithley648x() is called from the
     startup script with the following calling sequence.
 
-        drvAsynKeithley648x(type,myport,ioport,ioaddr)
+        drvAsynKeithley648x(type,myport,ioport,ioaddr,baud)
 
         Where:
             type   - "6485" or "6487"
             myport - Keithley648x Asyn interface port driver name (i.e. "EP0" )
-            ioport - Communication port driver name (i.e. "S0" )
+            ioport - Communication port driver name (i.e. "S0" ), or
+                     "file:<path>" to replay a captured reading file
             ioaddr - Communication port device addr
+            baud   - Serial baud rate to switch the instrument and port to
+                     at init, up to 57600 (0 = keep the current rate)
+
+    When the instrument does not answer *IDN? at the configured serial
+    rate (e.g. it kept a faster rate over a reboot of the IOC only), the
+    driver hunts through the instrument's rates with asynSetOption until
+    it answers. If switching to the requested rate fails, the port goes
+    back to the rate that worked.
+
+    In replay mode no communication port is used. The driver serves READ
+    and the status tags from the file, one record per READ? at the pace of
+    the recorded instrument timestamps scaled by REPLAY_SPEED (0 = as fast
+    as requested); the file is replayed in a loop. A file ending in ".bin"
+    holds packed native-endian records of reading (epicsFloat64),
+    timestamp (epicsFloat64) and status (epicsInt32); any other file is
+    text with one "reading,timestamp,status" line per record, the same
+    format as a READ? response ('#' starts a comment).
+
+    Readings are normally taken when the READ record processes. Setting
+    ACQUIRE to 1 starts a per-port acquisition thread that issues READ?
+    every ACQUIRE_PERIOD seconds (0 = back to back) and hands the parsed
+    readings through a lock-free single-producer/single-consumer ring to a
+    publishing thread, which updates the cache and calls back I/O Intr
+    records once per drained batch. READ then returns the cached value.
+    A full ring drops the reading and counts it in RING_OVERRUNS, so the
+    serial reads are never held up by slow callbacks.
+
+    Every reading is also kept in a circular history of the last
+    HISTORY_SIZE readings. HISTORY_VALUE and HISTORY_TIME (instrument
+    timestamps) are published oldest first as contiguous waveforms at most
+    every HISTORY_PERIOD seconds, together with their mean, RMS, minimum,
+    maximum and peak-to-peak (HISTORY_MEAN ... HISTORY_P2P).
+
+    With PSD_SEGMENT set (a power of two from 16 to 4096, 0 = off) the
+    noise spectrum of the history is computed whenever the history is
+    published, burst readings included. The readings since the last
+    time the instrument timestamps went backwards are resampled to even
+    spacing by linear interpolation and averaged over Hann windowed
+    segments of PSD_SEGMENT readings overlapping by half (Welch). PSD is
+    the one-sided power spectral density in A^2/Hz at the frequencies in
+    PSD_FREQUENCY, PSD_PEAK the frequency of its largest bin above DC
+    (mains pickup, pumps) and PSD_SEGMENTS the segments averaged, 0 while
+    the history is shorter than a segment.
+
+    HISTOGRAM counts the readings (overflows left out) into
+    HISTOGRAM_BINS bins (up to 1024, 0 = off) of HISTOGRAM_WIDTH
+    amperes, at one increment per reading. A width of 0 is chosen from
+    the spread of the first 32 readings, so the bins span about ten
+    standard deviations, but no bin is narrower than one count of the
+    reading. The bins are centered on the running mean of the readings
+    and move by whole bins once it drifted by a quarter of their span,
+    or are emptied and centered on it again when it left the span;
+    HISTOGRAM_AXIS holds the bin centers, HISTOGRAM_OUTSIDE the readings
+    that fell off either end. The histogram is published with the
+    history waveforms. HISTOGRAM_RESET, or a new bin count or
+    width, starts it again.
+
+    On the 6487 SWEEP_RUN runs the instrument's built-in voltage staircase
+    from SWEEP_START to SWEEP_STOP in SWEEP_STEP volts with SWEEP_DELAY
+    seconds per step, and reads all buffered readings with their source
+    voltage in one TRAC:DATA? transfer into the SWEEP_VOLTAGE and
+    SWEEP_CURRENT waveforms. Acquisition is held off during the sweep.
+
+    Also on the 6487, writing RAMP_TARGET ramps the source voltage there
+    at RAMP_RATE volts per second in the background: a ramp thread
+    writes a SOUR:VOLT step every 0.1 s between the readings of the
+    acquisition, starting from the voltage the source reports. The write
+    returns at once. RAMP_VOLTAGE, RAMP_PROGRESS (percent) and RAMP_STATE
+    follow the ramp; a new target takes over from where the ramp is and
+    RAMP_STOP holds the voltage reached.
+
+    PROFILE applies a named speed profile (MAX_SPEED, BALANCED or
+    LOW_NOISE: display, autozero, NPLC, filters, reading elements and
+    autorange) as a single ';' separated command line ended by *OPC?, so
+    the instrument never runs a half-applied combination. The settings
+    the reading rate depends on are kept in a cache, refreshed by one
+    batched query, and EXPECTED_RATE reports the reading rate they allow.
+    PROFILE reads back the profile the instrument currently matches, or
+    CUSTOM. With MAX_SPEED the instrument only returns the reading, so
+    TIMESTAMP holds host seconds and the status tags read zero.
+
+    SETUP_SAVE stores the present configuration in one of the
+    instrument's three setup memories (*SAV) and SETUP_RECALL brings one
+    back with a single *RCL;*OPC? line followed by the batched settings
+    query, so switching between e.g. an alignment and a measurement
+    configuration takes two transactions. SETUP reads back the memory
+    last saved or recalled, -1 if none.
+
+    BURST_COUNT above 1 sets TRIG:COUN so that one READ? returns that
+    many readings (up to 512), which spreads the cost of the exchange
+    over the burst. Every reading of a burst goes into the history,
+    charge, cadence and host filters like a single one; READ returns the
+    mean of the burst and BURST_SIGMA its standard deviation, while
+    BURST_VALUE and BURST_TIME hold the readings themselves. With
+    FORM:ELEM READ the readings are given host times spread back from
+    the reply by the expected reading period, and an overflow is known
+    from the reading of 9.9E37 alone. A larger TRIG:COUN found
+    on the instrument, set from the front panel or a recalled setup, is
+    written back as 512.
+
+    NPLC sets the integration time continuously from 0.01 to one second
+    of power line cycles (RATE keeps the three fixed steps) and AUTOZERO
+    switches autozero. The acquisition thread never polls faster than
+    EXPECTED_RATE, and READ? timeouts are stretched by the expected
+    reading period so long integrations and repeating filters complete.
+
+    IOCs with many instruments can share one I/O engine instead of giving
+    every port its own acquisition and publishing threads. Calling
+
+        drvAsynKeithley648xEngine(workers)
+
+    before the first drvAsynKeithley648x() starts a scheduler thread and
+    up to 16 publishing workers for all ports configured afterwards. The
+    scheduler queues each due READ? on the port's octet server with
+    pasynManager->queueRequest; the exchange runs in the octet server's
+    own thread and the reading goes through the port's ring to its
+    worker, so no engine thread ever blocks on a serial line. Replay ports
+    keep their own threads.
+
+    While CHARGE_RUN is set every reading is integrated over the
+    instrument timestamps (trapezoidal rule) into CHARGE, in coulombs,
+    whether it comes from READ or the acquisition thread. An interval is
+    left out and counted in CHARGE_GAPS when either end is an overflowed
+    reading, the timestamp went backwards (instrument reset or rollover),
+    or it is longer than CHARGE_GAP seconds (0 = no limit). CHARGE_RESET
+    clears the total.
+
+    The cadence of the readings is monitored from consecutive instrument
+    timestamps and host arrival times. INTERVAL_MEAN and INTERVAL_JITTER
+    are the smoothed mean and standard deviation of the instrument's
+    reading interval (over about the last 100 readings), ARRIVAL_JITTER
+    that of the intervals at which readings reach the host, which shows
+    serial contention. INTERVAL_MAX is the longest interval and
+    MISSED_READINGS the readings estimated lost in intervals longer than
+    1.5 mean intervals, both since INTERVAL_RESET.
+
+    Every reading also runs through a host side filter chain, so the
+    instrument's own filters can stay off at full speed. The stages run
+    in a fixed order, each taking the output of the one before and
+    published as its own tag: HOST_OUTLIER drops readings further than
+    HOST_OUTLIER_SIGMA standard deviations from the smoothed mean
+    (holding the last good one, counted in HOST_REJECTED; 5 in a row are
+    taken as a real step; the deviation is never taken below 3 counts of
+    the range the mean reads on, so a quiet input doesn't reject every
+    change of the last digit), HOST_MEDIAN is the median of the last
+    HOST_MEDIAN_WINDOW and HOST_AVERAGE the mean of the last
+    HOST_AVERAGE_WINDOW stage outputs (up to 64), and HOST_EXP smooths
+    with time constant HOST_EXP_TIME seconds of instrument time. A sigma,
+    window or time of 0 passes the stage through. Overflowed readings
+    skip the chain; HOST_FILTER_RESET or any change restarts it.
+
+    Photodiode currents are turned into beam power and photon flux with
+    a response table loaded, before or after iocInit, by
+
+        drvAsynKeithley648xResponse(myport,file)
+
+    The file holds energy (eV) and responsivity (A/W) pairs, one per
+    line, energies ascending, '#' starting a comment. Writing ENERGY
+    (e.g. from the monochromator through a CP link) interpolates
+    RESPONSIVITY once, so every reading then costs a division: POWER is
+    the reading over it in watts and FLUX the photons per second. Outside
+    the table RESPONSIVITY, POWER and FLUX read 0; overflowed readings
+    leave POWER and FLUX at their last value.
+
+    The read path of a tag, dispatch and parsing included, is timed by
+
+        drvAsynKeithley648xBench(myport,tag,iface,loops)
+
+    which reads tag loops times through interface iface (Float64, Int32
+    or Octet) with the port locked and prints the time per read and the
+    transactions it took. The k648xTest host test program ("make
+    runtests") runs it against the in-process mock port of k648xMock.cpp,
+    which measures the driver's own overhead without the serial line.
+
+    The integration time and filter that meet a noise target at the
+    highest rate are found, with zero check on or a steady input, by
+
+        drvAsynKeithley648xTune(myport,noise,readings)
+
+    which tries every NPLC 0.01 to 5 with the averaging filter off or
+    repeating over 5 or 20 readings, fastest expected first. Each
+    setting is measured over readings readings (default 20) taken the
+    way READ takes them, bursts included, for their standard deviation
+    and the reading rate actually reached, and the whole table is
+    printed. Of the settings whose deviation is at most noise amperes
+    the one with the highest measured rate is applied; if none is quiet
+    enough the settings before the run come back. A warning is printed
+    when zero check is off. The port is held for the run.
+
+    I/O Intr callbacks of a Float64 tag (READ, CHARGE, the history
+    statistics, ...) can be thinned out per port and tag with
+
+        drvAsynKeithley648xDeadband(myport,tag,absolute,relative,maxRate)
+
+    A value is then only sent when it moved more than absolute, or more
+    than relative times the last sent value, from the last sent value
+    (both 0 = any value qualifies), and at most maxRate times a second
+    (0 = no limit). Every reading still goes into the history, charge
+    and statistics, which see all samples.
+
+    Every exchange with the instrument (command, start time, duration,
+    status, byte counts and the start of the response) goes into a
+    per-port ring of the last RECORDER_SIZE transactions. The ring is
+    printed, oldest first, with
+
+        drvAsynKeithley648xDump(myport,count)
+
+    (count 0 = all), and automatically on the first I/O error after a
+    successful exchange unless turned off with
+
+        drvAsynKeithley648xAutoDump(myport,enable)
+
+    The port has two asyn addresses. The databases put the data tags
+    (READ, TIMESTAMP, the status, history, sweep result and charge
+    tags) on address 0 and everything that configures the instrument or
+    the driver on address 1, but every tag is served on either, so
+    databases with all tags on address 0 keep working. asyn queues the
+    requests of the port by priority, so data records with PRIO=HIGH are
+    served before any waiting configuration request (PRIO LOW), and a
+    refresh of all settings no longer holds up readings by more than the
+    one exchange in progress.
+
+    STATUS_RAW is also served through asynUInt32Digital. Its I/O Intr
+    clients are called back only when a bit inside their mask changed,
+    so bi and mbbiDirect records on single status bits process on
+    change instead of with every reading.
 
     The method dbior can be called from the IOC shell to display the current
     status of the driver.
@@ -31,26 +258,358 @@
 #include <epicsString.h>
 #include <epicsExport.h>
 #include <errlog.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
 
 /* EPICS synApps/Asyn related include files */
 #include <asynDriver.h>
 #include <asynDrvUser.h>
 #include <asynInt32.h>
 #include <asynFloat64.h>
+#include <asynFloat64Array.h>
+#include <asynInt32Array.h>
+#include <asynUInt32Digital.h>
 #include <asynOctet.h>
 #include <asynOctetSyncIO.h>
 #include <asynStandardInterfaces.h>
+#include <asynShellCommands.h>
+
+#include "k648xReduce.h"
+#include "k648xSpectrum.h"
 
 /* Define symbolic constants */
 #define TIMEOUT         (5.0)
+#define PROBE_TIMEOUT   (0.5)
 #define BUFFER_SIZE     (100)
+#define REPLAY_PREFIX   "file:"
+#define REPLAY_SETTINGS (64)
+#define RING_SIZE       (1024)  /* must be a power of two */
+#define PUBLISH_BATCH   (64)
+#define HISTORY_SIZE    (4096)
+#define RESPONSE_SIZE   (4096)  /* energies in a response table */
+#define ELECTRON_VOLT   (1.602176634e-19) /* J */
+#define SWEEP_MAX_POINTS (3000) /* 6487 reading buffer size */
+#define RAMP_STEP_PERIOD (0.1)  /* s between SOUR:VOLT steps of a ramp */
+#define SETUP_SLOTS     (3)     /* *SAV / *RCL memories 0 to 2 */
+#define BURST_MAX       (512)   /* readings per READ?, half the ring */
+#define BURST_BUFFER    (BURST_MAX * 48) /* reply of a full burst */
+#define OVERFLOW_READING (9.9e37) /* A, reported for an overflow */
+#define READING_OVERHEAD (0.00083) /* s per reading besides integration */
+#define DISPLAY_OVERHEAD (0.004)   /* s per reading added by the display */
+#define ENGINE_MAX_WORKERS (16)
+#define ENGINE_IDLE_WAIT (1.0)     /* s between scheduler passes when idle */
+#define CADENCE_WEIGHT  (0.01)  /* smoothing of interval mean and jitter */
+#define CADENCE_GAP     (1.5)   /* mean intervals before readings are missed */
+#define TUNE_READINGS   (20)    /* default readings per tuner setting */
+#define PSD_MIN_SEGMENT (16)    /* readings in the shortest Welch segment */
+#define HISTOGRAM_BINS  (1024)  /* most bins of the reading histogram */
+#define HISTOGRAM_WARMUP (32)   /* readings before the bins are placed */
+#define HISTOGRAM_SPAN  (10.0)  /* standard deviations of an automatic span */
+#define HISTOGRAM_WEIGHT (0.001) /* smoothing of the mean it is centered on */
+#define FILTER_WINDOW   (64)    /* longest median and average window */
+#define FILTER_WEIGHT   (0.01)  /* smoothing of the outlier mean and sigma */
+#define FILTER_WARMUP   (10)    /* readings before outliers are rejected */
+#define FILTER_STEP     (5)     /* outliers in a row taken as a step */
+#define FILTER_COUNTS   (3.0)   /* least outlier sigma, in reading counts */
+#define RECORDER_SIZE   (64)    /* must be a power of two */
+#define RECORDER_COMMAND (32)
+#define RECORDER_RESPONSE (64)
+
+/* Full memory barrier ordering ring slot accesses against index updates */
+#if defined(__GNUC__)
+#define MEMORY_BARRIER() __sync_synchronize()
+#elif defined(_WIN32)
+#include <windows.h>
+#define MEMORY_BARRIER() MemoryBarrier()
+#else
+#error "No memory barrier available for the reading ring"
+#endif
 
 
-typedef enum {Octet=1, Float64=2, Int32=3} Type;
+typedef enum {Octet=1, Float64=2, Int32=3, Float64Array=4, 
+              Int32Array=5} Type;
 
 static const char *driver = "drvAsynKeithley648x";      /* String for asynPrint */
 
 
+/* Declare replay (virtual instrument) structures */
+struct ReplayRecord
+{
+  double reading;
+  double timestamp;
+  int status;
+};
+
+struct ReplaySetting
+{
+  char key[32];
+  char value[32];
+};
+
+struct Replay
+{
+  char *path;
+  ReplayRecord *records;
+  int count;
+  int next;
+  int passes;
+  double speed;         // pace multiplier, 0 serves records as fast as read
+  epicsTimeStamp start; // host time at which records[0] is due
+  int nsettings;
+  ReplaySetting settings[REPLAY_SETTINGS];
+  epicsMutexId lock;    // serializes the virtual instrument between threads
+};
+
+
+/* Declare parsed reading and lock-free reading ring structures */
+struct Reading
+{
+  double reading;
+  double timestamp;     // instrument timestamp
+  int status;
+  epicsTimeStamp time;  // host arrival time
+  int burst;            // 0 alone, -1 inside a burst, n on the last of n
+};
+
+struct Ring
+{
+  Reading slot[RING_SIZE];
+  volatile unsigned int head;   // written by the acquisition thread only
+  volatile unsigned int tail;   // written by the publishing thread only
+  int overruns;
+  int batches;
+  int published;
+  int maxBatch;
+};
+
+
+/* Declare circular reading history structure */
+struct History
+{
+  double value[HISTORY_SIZE];
+  double time[HISTORY_SIZE];
+  unsigned int count;     // readings pushed, next slot is count % HISTORY_SIZE
+  double period;          // minimum seconds between published snapshots
+  epicsTimeStamp last;    // host time of the last published snapshot
+  double snapValue[HISTORY_SIZE];
+  double snapTime[HISTORY_SIZE];
+  k648xStats stats;       // of the last published snapshot
+};
+
+
+/* Declare noise spectrum structure */
+struct Spectrum
+{
+  int segment;            // readings per Welch segment, 0 = off
+  int segments;           // averaged into psd, 0 if there were too few
+  int length;             // of psd and freq
+  double peak;            // Hz, largest bin above DC
+  double uniform[HISTORY_SIZE];     // history resampled to even spacing
+  double work[2 * HISTORY_SIZE];
+  double psd[HISTORY_SIZE / 2 + 1];   // A^2/Hz
+  double freq[HISTORY_SIZE / 2 + 1];  // Hz
+};
+
+
+/* Declare reading histogram structure */
+struct Histogram
+{
+  int bins;               // 0 = off
+  double width;           // requested per bin, 0 = from the warm-up spread
+  double binWidth;        // in use
+  double center;          // reading at the middle of the bins
+  int placed;             // center and binWidth are set
+  unsigned int count;     // readings since reset
+  double mean;            // running, the bins follow it
+  double m2;              // sum of squared deviations over the warm-up
+  double warmup[HISTOGRAM_WARMUP];
+  int outside;            // readings off either end
+  epicsInt32 counts[HISTOGRAM_BINS];
+  double axis[HISTOGRAM_BINS];  // bin centers
+};
+
+
+/* Declare voltage sweep structure */
+enum { SWEEP_IDLE, SWEEP_RUNNING, SWEEP_DONE, SWEEP_FAILED };
+
+struct Sweep
+{
+  double start;
+  double stop;
+  double step;
+  double delay;
+  int points;
+  int state;
+  size_t count;           // points in the last completed sweep
+  double voltage[SWEEP_MAX_POINTS];
+  double current[SWEEP_MAX_POINTS];
+  char *buffer;           // TRAC:DATA? response, allocated on first sweep
+};
+
+
+/* Declare burst reading structure */
+struct Burst
+{
+  int count;              // TRIG:COUN, 1 = single readings
+  char *buffer;           // READ? reply, allocated on the first burst
+  Reading *readings;      // parsed from buffer
+  double mean;
+  double sigma;
+  double value[BURST_MAX];  // readings of the last completed burst
+  double time[BURST_MAX];   // and their instrument timestamps
+  int length;
+  int fresh;              // not yet published
+};
+
+
+/* Declare voltage ramp structure */
+enum { RAMP_IDLE, RAMP_RUNNING, RAMP_DONE, RAMP_STOPPED, RAMP_FAILED };
+
+struct Ramp
+{
+  double target;          // volts
+  double rate;            // volts per second
+  double from;            // where the ramp to target started
+  double voltage;         // last written to the source
+  int state;
+  int stop;               // stop requested
+  epicsEventId wake;      // NULL until the first ramp starts the thread
+};
+
+
+/* Declare charge integration structure */
+struct Charge
+{
+  int running;
+  double total;           // coulombs
+  double maxGap;          // longer reading intervals are not integrated
+  int gaps;               // intervals left out
+  int valid;              // last reading may start the next interval
+  double lastReading;
+  double lastTime;
+};
+
+
+/* Declare reading interval monitor structure */
+struct Cadence
+{
+  int valid;              // last reading may start the next interval
+  double lastStamp;       // instrument timestamp
+  epicsTimeStamp lastTime;  // host arrival
+  unsigned int intervals;
+  double mean;            // instrument interval, smoothed
+  double variance;
+  double arrivalMean;     // host arrival interval, smoothed
+  double arrivalVariance;
+  double maxGap;          // since reset
+  int missed;             // since reset
+};
+
+
+/* Declare response table structure */
+struct ResponseTable
+{
+  int count;
+  double energy[RESPONSE_SIZE];     // eV, ascending
+  double response[RESPONSE_SIZE];   // A/W
+};
+
+struct Response
+{
+  ResponseTable *table;   // NULL until one is loaded
+  double energy;          // eV
+  double responsivity;    // A/W at energy, 0 outside the table
+  double power;           // W
+  double flux;            // photons/s
+};
+
+
+/* Declare host filter chain structure */
+struct Filter
+{
+  // configuration, 0 passes a stage through
+  double outlierSigma;
+  int medianWindow;
+  int averageWindow;
+  double expTime;         // seconds
+
+  int valid;              // stage outputs below hold a reading
+  unsigned int count;     // for the outlier statistics
+  double mean;
+  double variance;
+  int run;                // outliers in a row
+  int rejected;           // since reset
+  double median[FILTER_WINDOW];
+  int medianCount, medianNext;
+  double average[FILTER_WINDOW];
+  int averageCount, averageNext;
+  double averageSum;
+  double lastTime;        // instrument timestamp, for the exponential
+
+  double outlierOut, medianOut, averageOut, expOut;
+};
+
+
+/* Declare callback deadband structure */
+struct Deadband
+{
+  double absolute;        // minimum change from the last sent value
+  double relative;        // minimum change as a fraction of it
+  double minInterval;     // seconds between sends, 1 / maximum rate
+  int active;
+  int sent;               // last and lastTime are valid
+  double last;
+  epicsTimeStamp lastTime;
+  unsigned int generation;  // publish pass the decision was made in
+  int decision;
+  int suppressed;
+};
+
+
+/* Declare I/O flight recorder structures */
+struct Transaction
+{
+  epicsTimeStamp start;
+  double duration;        // seconds
+  int status;
+  int nWrite;
+  int nRead;
+  char command[RECORDER_COMMAND];     // truncated
+  char response[RECORDER_RESPONSE];   // truncated, raw bytes
+};
+
+struct Recorder
+{
+  epicsMutexId lock;
+  Transaction entry[RECORDER_SIZE];
+  unsigned int count;     // transactions recorded, wraps with the ring
+  int autoDump;           // dump on the first error after a success
+  int armed;              // last transaction succeeded
+  int dumps;
+};
+
+
+/* Declare instrument settings cache and speed profile structures */
+enum { PROFILE_MAX_SPEED, PROFILE_BALANCED, PROFILE_LOW_NOISE, 
+       PROFILE_CUSTOM };
+
+struct Settings
+{
+  double nplc;
+  int autozero;
+  int display;
+  int average;            // digital (averaging) filter
+  int averageCount;
+  int averageRepeat;      // repeating rather than moving average
+  int median;
+  int rangeAuto;
+  int readingOnly;        // FORM:ELEM READ, no timestamp and status
+  double lineFrequency;   // not part of a profile
+};
+
+
 /* Declare port driver structure */
 struct Port
 {
@@ -58,6 +617,7 @@ struct Port
   char* myport;
   char* ioport;
   int ioaddr;
+  int baud; // serial rate found or negotiated at init, 0 if not serial
 
   int init; // really needed??
 
@@ -110,9 +670,52 @@ struct Port
        9 (Zero Check)   — Set to 1 when zero check is enabled.
       10 (Zero Correct) — Set to 1 when zero correct is enabled.
     */
-    int eom;
   } data;
 
+  epicsUInt32 statusPublished; // status last sent to UInt32Digital clients
+  int statusValid;             // statusPublished has been sent once
+
+  Replay *replay; // NULL unless serving a captured reading file
+
+  epicsMutexId lock; // guards data against the publishing thread
+
+  struct
+  {
+    int enabled;
+    double period;
+    epicsEventId wake;
+    epicsEventId ready;
+    epicsMutexId ioLock; // held per transaction, or across a sweep
+    int readings;
+    int errors;
+
+    // shared I/O engine only
+    asynUser *pasynUserQueue;  // queued READ? on the octet server
+    asynOctet *pasynOctet;
+    void *octetPvt;
+    volatile int pending;      // request queued and not yet completed
+    epicsTimeStamp due;        // next READ? is queued at or after this time
+    int worker;                // publishing worker draining the ring
+  } acq;
+
+  Ring ring;
+  History history;
+  Burst burst;       // guarded by lock, buffers by acq.ioLock
+  Histogram histogram; // guarded by lock
+  Spectrum spectrum; // guarded by lock
+  Sweep sweep;
+  Ramp ramp;         // guarded by lock
+  Settings settings; // guarded by lock
+  int setup;         // setup memory last saved or recalled, -1 if none
+  Charge charge;     // guarded by lock
+  Cadence cadence;   // guarded by lock
+  Filter filter;     // guarded by lock
+  Response response; // guarded by lock
+
+  Deadband *deadband;         // per command, indexed by reason
+  Recorder recorder;
+  unsigned int generation;    // publish passes, see deadbandPass
+
   /* Asyn info */
   asynUser *pasynUser;
   asynUser *pasynUserTrace;  /* asynUser for asynTrace on this port */
@@ -120,10 +723,27 @@ struct Port
 };
 
 
+/* Declare shared I/O engine structure */
+struct Engine
+{
+  int workers;
+  int nports;
+  Port **ports;
+  epicsMutexId lock;                        // guards ports and nports
+  epicsEventId wake;                        // scheduler
+  epicsEventId ready[ENGINE_MAX_WORKERS];   // one per publishing worker
+  int requests;
+  int skipped;                              // line held by a sweep
+};
+
+static Engine *engine = NULL;   // NULL unless drvAsynKeithley648xEngine ran
+
+
 struct Command
 {
   const char *tag;
   int dev;
+  int addr;     // ADDR_DATA or ADDR_CONFIG
   int type;
   int id;
 };
@@ -144,7 +764,18 @@ struct SimpleCommand
 };
 
 /* Public interface forward references */
-int drvAsynKeithley648x(const char* myport,const char* ioport, int ioaddr);
+int drvAsynKeithley648x(const char *type, const char *myport,
+                        const char *ioport, int ioaddr, int baud);
+int drvAsynKeithley648xEngine(int workers);
+int drvAsynKeithley648xDeadband(const char *myport, const char *tag, 
+                                double absolute, double relative, 
+                                double maxRate);
+int drvAsynKeithley648xDump(const char *myport, int count);
+int drvAsynKeithley648xAutoDump(const char *myport, int enable);
+int drvAsynKeithley648xResponse(const char *myport, const char *file);
+int drvAsynKeithley648xBench(const char *myport, const char *tag, 
+                             const char *iface, int loops);
+int drvAsynKeithley648xTune(const char *myport, double noise, int readings);
 
 
 /* Forward references for asynCommon methods */
@@ -173,6 +804,31 @@ static asynStatus readInt32(void* ppvt,asynUser* pasynUser,epicsInt32* value);
 static asynStatus writeInt32(void* ppvt,asynUser* pasynUser,epicsInt32 value);
 static asynInt32 ifaceInt32 =  {writeInt32, readInt32};
 
+/* Forward references for asynFloat64Array methods */
+static asynStatus readFloat64Array(void* ppvt,asynUser* pasynUser,
+                                   epicsFloat64* value,size_t nelements,
+                                   size_t* nIn);
+static asynStatus writeFloat64Array(void* ppvt,asynUser* pasynUser,
+                                    epicsFloat64* value,size_t nelements);
+static asynFloat64Array ifaceFloat64Array = {writeFloat64Array, 
+                                             readFloat64Array};
+
+/* Forward references for asynInt32Array methods */
+static asynStatus readInt32Array(void* ppvt,asynUser* pasynUser,
+                                 epicsInt32* value,size_t nelements,
+                                 size_t* nIn);
+static asynStatus writeInt32Array(void* ppvt,asynUser* pasynUser,
+                                  epicsInt32* value,size_t nelements);
+static asynInt32Array ifaceInt32Array = {writeInt32Array, readInt32Array};
+
+/* Forward references for asynUInt32Digital methods */
+static asynStatus readUInt32Digital(void* ppvt,asynUser* pasynUser,
+                                    epicsUInt32* value,epicsUInt32 mask);
+static asynStatus writeUInt32Digital(void* ppvt,asynUser* pasynUser,
+                                     epicsUInt32 value,epicsUInt32 mask);
+static asynUInt32Digital ifaceUInt32Digital = {writeUInt32Digital, 
+                                               readUInt32Digital};
+
 /* Forward references for asynOctet methods */
 static asynStatus flushOctet( void* ppvt, asynUser* pasynUser);
 static asynStatus writeOctet( void* ppvt, asynUser* pasynUser, const char *data,
@@ -186,6 +842,14 @@ static asynOctet ifaceOctet = { writeOctet, readOctet, flushOctet};
 static asynStatus writeOnly(Port* pport, const char* outBuf);
 static asynStatus writeRead(Port* pport, const char* outBuf, char* inpBuf,
                             int inputSize, int *eomReason);
+static void recordTransaction(Port *pport, const char *outBuf, 
+                              const char *inpBuf, size_t nWrite, 
+                              size_t nRead, asynStatus status, 
+                              const epicsTimeStamp *start);
+static void recorderDump(Port *pport, int count);
+static asynStatus writeReadTimeout(Port* pport, const char* outBuf, 
+                                   char* inpBuf, int inputSize, 
+                                   int *eomReason, double timeout);
 
 
 static asynStatus readDummy(int which, Port *pport, void *data, Type Iface, 
@@ -215,121 +879,321 @@ static asynStatus writeVoltageSettings(int which, Port *pport, void* data,
 static asynStatus readCommon(int which, Port *pport, void* data, 
                              Type Iface, size_t *length, int *eom);
 static asynStatus writeCommon(int which, Port *pport, void* data, Type Iface);
+static asynStatus readReplay(int which, Port *pport, void* data, 
+                             Type Iface, size_t *length, int *eom);
+static asynStatus writeReplay(int which, Port *pport, void* data, Type Iface);
+static asynStatus readAcquire(int which, Port *pport, void* data, 
+                              Type Iface, size_t *length, int *eom);
+static asynStatus writeAcquire(int which, Port *pport, void* data, Type Iface);
+static asynStatus readHistory(int which, Port *pport, void* data, 
+                              Type Iface, size_t *length, int *eom);
+static asynStatus writeHistory(int which, Port *pport, void* data, Type Iface);
+static asynStatus readSweep(int which, Port *pport, void* data, 
+                            Type Iface, size_t *length, int *eom);
+static asynStatus writeSweep(int which, Port *pport, void* data, Type Iface);
+static asynStatus readSpectrum(int which, Port *pport, void* data, 
+                               Type Iface, size_t *length, int *eom);
+static asynStatus writeSpectrum(int which, Port *pport, void* data, 
+                                Type Iface);
+static asynStatus readHistogram(int which, Port *pport, void* data, 
+                                Type Iface, size_t *length, int *eom);
+static asynStatus writeHistogram(int which, Port *pport, void* data, 
+                                 Type Iface);
+static asynStatus readBurst(int which, Port *pport, void* data, 
+                            Type Iface, size_t *length, int *eom);
+static asynStatus writeBurst(int which, Port *pport, void* data, Type Iface);
+static asynStatus readRamp(int which, Port *pport, void* data, 
+                           Type Iface, size_t *length, int *eom);
+static asynStatus writeRamp(int which, Port *pport, void* data, Type Iface);
+static void rampTask(void *arg);
+static asynStatus readProfile(int which, Port *pport, void* data, 
+                              Type Iface, size_t *length, int *eom);
+static asynStatus writeProfile(int which, Port *pport, void* data, Type Iface);
+static asynStatus readSetup(int which, Port *pport, void* data, 
+                            Type Iface, size_t *length, int *eom);
+static asynStatus writeSetup(int which, Port *pport, void* data, Type Iface);
+static asynStatus readCharge(int which, Port *pport, void* data, 
+                             Type Iface, size_t *length, int *eom);
+static asynStatus writeCharge(int which, Port *pport, void* data, Type Iface);
+static asynStatus readInterval(int which, Port *pport, void* data, 
+                               Type Iface, size_t *length, int *eom);
+static asynStatus writeInterval(int which, Port *pport, void* data, 
+                                Type Iface);
 
+static asynStatus readEnergy(int which, Port *pport, void* data, 
+                             Type Iface, size_t *length, int *eom);
+static asynStatus writeEnergy(int which, Port *pport, void* data, 
+                              Type Iface);
+static asynStatus readFilter(int which, Port *pport, void* data, 
+                             Type Iface, size_t *length, int *eom);
+static asynStatus writeFilter(int which, Port *pport, void* data, 
+                              Type Iface);
+
+/* Forward references for settings cache methods */
+static asynStatus refreshSettings(Port *pport);
+static void noteSimpleSetting(Port *pport, int which, double val);
+static int matchProfile(const Settings *pset);
+static double expectedRate(const Settings *pset);
+static double readingPeriod(Port *pport);
+
+/* Forward references for acquisition and publishing methods */
+static int parseReading(char *inpBuf, Reading *prd);
+static int parseReadings(Port *pport, char *inpBuf, Reading *prd, int count);
+static void setBurstCount(Port *pport, int count);
+static int burstCount(Port *pport);
+static void finishBurst(Port *pport, int n);
+static void processReading(Port *pport, const Reading *prd);
+static void integrateCharge(Charge *pchg, const Reading *prd);
+static void updateCadence(Cadence *pcad, const Reading *prd);
+static double readingCount(double x);
+static void resetFilter(Filter *pflt);
+static void filterReading(Filter *pflt, const Reading *prd);
+static double interpolateResponse(const ResponseTable *ptab, double energy);
+static void updateSpectrum(Port *pport, size_t count);
+static void resetHistogram(Histogram *phst);
+static void histogramReading(Histogram *phst, double reading);
+static void publishReadings(Port *pport);
+static void publishInt32Cache(Port *pport);
+static void publishFloat64Cache(Port *pport);
+static void publishStatus(Port *pport);
+static int deadbandPass(Port *pport, int reason, double value, 
+                        unsigned int generation);
+static void publishArray(Port *pport, int which, double *value, size_t count);
+static void publishInt32Array(Port *pport, int which, epicsInt32 *value, 
+                              size_t count);
+static size_t historySnapshot(Port *pport, double *value, double *time, 
+                              size_t max);
+static int drainRing(Port *pport);
+static void acquireTask(void *arg);
+static void publishTask(void *arg);
+
+/* Forward references for shared I/O engine methods */
+static asynStatus engineAdd(Port *pport);
+static void engineProcess(asynUser *pasynUser);
+static void engineTimeout(asynUser *pasynUser);
+static void engineTask(void *arg);
+static void engineWorker(void *arg);
+
+/* Forward references for replay (virtual instrument) methods */
+static Replay *replayOpen(const char *path);
+static asynStatus replayWriteRead(Port *pport, const char *outBuf, 
+                                  char *inpBuf, int inputSize, size_t *nRead);
+
+/* Forward references for serial baud rate methods */
+static asynStatus findBaud(Port *pport, char *inpBuf, int inputSize);
+static asynStatus negotiateBaud(Port *pport, int baud);
 
 
 
-// General commands that need special attention go here
-enum { VOID_CMD, READ_CMD, RANGE_CMD, RANGE_AUTO_ULIMIT_CMD, 
-       RANGE_AUTO_LLIMIT_CMD, RATE_CMD, DIGITAL_FILTER_CONTROL_CMD,
-       VOLTAGE_RANGE_CMD, VOLTAGE_CURRENT_LIMIT_CMD,      GEN_CMD_NUMBER };
-static GenCommand genCommandTable[GEN_CMD_NUMBER] = 
-  {
-    { readDummy,           writeDummy},     // VOID
-    { readSensorReading,   writeDummy},     // READ
-    { readRange,           writeRange},     // RANGE
-    { readRange,           writeRange},     // RANGE_AUTO_ULIMIT
-    { readRange,           writeRange},     // RANGE_AUTO_LLIMIT
-    { readRate,            writeRate},      // RATE
-    { readCommon,          writeCommon},    // DIGITAL_FILTER_CONTROL
-    { readVoltageSettings, writeVoltageSettings}, // VOLTAGE_RANGE_COMMAND
-    { readVoltageSettings, writeVoltageSettings}, // VOLTAGE_CURRENT_LIMIT_COMMAND
-  };
 
-// commands that are very simple-minded go here
-enum { RESET_CMD, RANGE_AUTO_CMD,
-       ZERO_CHECK_CMD, ZERO_CORRECT_CMD, ZERO_CORRECT_ACQUIRE_CMD, 
-       MEDIAN_FILTER_CMD, MEDIAN_FILTER_RANK_CMD, 
-       DIGITAL_FILTER_CMD, DIGITAL_FILTER_COUNT_CMD, 
-       VOLTAGE_CMD, VOLTAGE_STATE_CMD, VOLTAGE_10V_INTERLOCK_CMD, VOLTAGE_INTERLOCK_STATUS_CMD,
-       SIMPLE_CMD_NUMBER};
+/*
+ * The commands are specified once, in the lists below; the id enums, the
+ * GEN and SIMPLE method tables and the tag table are all generated from
+ * them, so they can't get out of step. A tag is its id's name. Adding a
+ * tag takes one line here (plus the read/write methods for GEN). The
+ * address is the asyn address the databases use for the tag; create()
+ * accepts the tag on any address.
+ */
 
+enum { CMD_GEN, CMD_SIMPLE, CMD_CACHE };
+enum { DEV_ALL, DEV_6485, DEV_6487};
+enum { ADDR_DATA, ADDR_CONFIG };
 enum { SIMPLE_TRIGGER=0, SIMPLE_OCTET=Octet, SIMPLE_FLOAT64=Float64, 
        SIMPLE_INT32=Int32 };
-static SimpleCommand simpleCommandTable[SIMPLE_CMD_NUMBER] = 
-  {
-    { SIMPLE_TRIGGER, "*RST"},                // RESET DEVICE
-
-    { SIMPLE_INT32,   ":RANGE:AUTO"},         // RANGE_AUTO
 
-    { SIMPLE_INT32,   "SYST:ZCH"},            // ZERO CHECK
-    { SIMPLE_INT32,   "SYST:ZCOR"},           // ZERO CORRECT
-    { SIMPLE_TRIGGER, "SYST:ZCOR:ACQ"},       // ZERO CORRECT ACQUIRE
+// General commands that need special attention go here
+//   X( id, device, address, read method, write method)
+#define GEN_COMMANDS(X) \
+  X( VOID,                   DEV_ALL,  ADDR_CONFIG, readDummy,           writeDummy) \
+  X( READ,                   DEV_ALL,  ADDR_DATA,   readSensorReading,   writeDummy) \
+  X( RANGE,                  DEV_ALL,  ADDR_CONFIG, readRange,           writeRange) \
+  X( RANGE_AUTO_ULIMIT,      DEV_ALL,  ADDR_CONFIG, readRange,           writeRange) \
+  X( RANGE_AUTO_LLIMIT,      DEV_ALL,  ADDR_CONFIG, readRange,           writeRange) \
+  X( RATE,                   DEV_ALL,  ADDR_CONFIG, readRate,            writeRate) \
+  X( DIGITAL_FILTER_CONTROL, DEV_ALL,  ADDR_CONFIG, readCommon,          writeCommon) \
+  X( VOLTAGE_RANGE,          DEV_6487, ADDR_CONFIG, readVoltageSettings, writeVoltageSettings) \
+  X( VOLTAGE_CURRENT_LIMIT,  DEV_6487, ADDR_CONFIG, readVoltageSettings, writeVoltageSettings) \
+  X( REPLAY_SPEED,           DEV_ALL,  ADDR_CONFIG, readReplay,          writeReplay) \
+  X( ACQUIRE,                DEV_ALL,  ADDR_CONFIG, readAcquire,         writeAcquire) \
+  X( ACQUIRE_PERIOD,         DEV_ALL,  ADDR_CONFIG, readAcquire,         writeAcquire) \
+  X( HISTORY_PERIOD,         DEV_ALL,  ADDR_CONFIG, readHistory,         writeHistory) \
+  X( HISTORY_RESET,          DEV_ALL,  ADDR_CONFIG, readHistory,         writeHistory) \
+  X( BURST_COUNT,            DEV_ALL,  ADDR_CONFIG, readBurst,           writeBurst) \
+  X( PSD_SEGMENT,            DEV_ALL,  ADDR_CONFIG, readSpectrum,        writeSpectrum) \
+  X( HISTOGRAM_BINS,         DEV_ALL,  ADDR_CONFIG, readHistogram,       writeHistogram) \
+  X( HISTOGRAM_WIDTH,        DEV_ALL,  ADDR_CONFIG, readHistogram,       writeHistogram) \
+  X( HISTOGRAM_RESET,        DEV_ALL,  ADDR_CONFIG, readHistogram,       writeHistogram) \
+  X( SWEEP_START,            DEV_6487, ADDR_CONFIG, readSweep,           writeSweep) \
+  X( SWEEP_STOP,             DEV_6487, ADDR_CONFIG, readSweep,           writeSweep) \
+  X( SWEEP_STEP,             DEV_6487, ADDR_CONFIG, readSweep,           writeSweep) \
+  X( SWEEP_DELAY,            DEV_6487, ADDR_CONFIG, readSweep,           writeSweep) \
+  X( SWEEP_RUN,              DEV_6487, ADDR_CONFIG, readSweep,           writeSweep) \
+  X( RAMP_TARGET,            DEV_6487, ADDR_CONFIG, readRamp,            writeRamp) \
+  X( RAMP_RATE,              DEV_6487, ADDR_CONFIG, readRamp,            writeRamp) \
+  X( RAMP_STOP,              DEV_6487, ADDR_CONFIG, readRamp,            writeRamp) \
+  X( PROFILE,                DEV_ALL,  ADDR_CONFIG, readProfile,         writeProfile) \
+  X( SETUP_SAVE,             DEV_ALL,  ADDR_CONFIG, readSetup,           writeSetup) \
+  X( SETUP_RECALL,           DEV_ALL,  ADDR_CONFIG, readSetup,           writeSetup) \
+  X( NPLC,                   DEV_ALL,  ADDR_CONFIG, readRate,            writeRate) \
+  X( CHARGE_RUN,             DEV_ALL,  ADDR_CONFIG, readCharge,          writeCharge) \
+  X( CHARGE_RESET,           DEV_ALL,  ADDR_CONFIG, readCharge,          writeCharge) \
+  X( CHARGE_GAP,             DEV_ALL,  ADDR_CONFIG, readCharge,          writeCharge) \
+  X( INTERVAL_RESET,         DEV_ALL,  ADDR_CONFIG, readInterval,        writeInterval) \
+  X( HOST_OUTLIER_SIGMA,     DEV_ALL,  ADDR_CONFIG, readFilter,          writeFilter) \
+  X( HOST_MEDIAN_WINDOW,     DEV_ALL,  ADDR_CONFIG, readFilter,          writeFilter) \
+  X( HOST_AVERAGE_WINDOW,    DEV_ALL,  ADDR_CONFIG, readFilter,          writeFilter) \
+  X( HOST_EXP_TIME,          DEV_ALL,  ADDR_CONFIG, readFilter,          writeFilter) \
+  X( HOST_FILTER_RESET,      DEV_ALL,  ADDR_CONFIG, readFilter,          writeFilter) \
+  X( ENERGY,                 DEV_ALL,  ADDR_CONFIG, readEnergy,          writeEnergy)
 
-    { SIMPLE_INT32,   "MED"},                 // MEDIAN FILTER
-    { SIMPLE_INT32,   "MED:RANK"},            // MEDIAN FILTER RANK
+// commands that are very simple-minded go here
+//   X( id, device, address, type, SCPI command)
+#define SIMPLE_COMMANDS(X) \
+  X( RESET,                    DEV_ALL,  ADDR_CONFIG, SIMPLE_TRIGGER, "*RST") \
+  X( RANGE_AUTO,               DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   ":RANGE:AUTO") \
+  X( ZERO_CHECK,               DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   "SYST:ZCH") \
+  X( ZERO_CORRECT,             DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   "SYST:ZCOR") \
+  X( ZERO_CORRECT_ACQUIRE,     DEV_ALL,  ADDR_CONFIG, SIMPLE_TRIGGER, "SYST:ZCOR:ACQ") \
+  X( AUTOZERO,                 DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   "SYST:AZER") \
+  X( MEDIAN_FILTER,            DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   "MED") \
+  X( MEDIAN_FILTER_RANK,       DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   "MED:RANK") \
+  X( DIGITAL_FILTER,           DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   "AVER") \
+  X( DIGITAL_FILTER_COUNT,     DEV_ALL,  ADDR_CONFIG, SIMPLE_INT32,   "AVER:COUN") \
+  X( VOLTAGE,                  DEV_6487, ADDR_CONFIG, SIMPLE_FLOAT64, "SOUR:VOLT") \
+  X( VOLTAGE_STATE,            DEV_6487, ADDR_CONFIG, SIMPLE_INT32,   "SOUR:VOLT:STAT") \
+  X( VOLTAGE_TENV_INTERLOCK,   DEV_6487, ADDR_CONFIG, SIMPLE_INT32,   "SOUR:VOLT:INT") \
+  X( VOLTAGE_INTERLOCK_STATUS, DEV_6487, ADDR_CONFIG, SIMPLE_INT32,   "SOUR:VOLT:INT:FAIL")
+
+// values kept by the driver and served from its cache
+//   X( id, device, address)
+#define CACHE_COMMANDS(X) \
+  X( TIMESTAMP,           DEV_ALL,  ADDR_DATA) \
+  X( STATUS_RAW,          DEV_ALL,  ADDR_DATA) \
+  X( STATUS_OVERFLOW,     DEV_ALL,  ADDR_DATA) \
+  X( STATUS_FILTER,       DEV_ALL,  ADDR_DATA) \
+  X( STATUS_MATH,         DEV_ALL,  ADDR_DATA) \
+  X( STATUS_NULL,         DEV_ALL,  ADDR_DATA) \
+  X( STATUS_LIMITS,       DEV_ALL,  ADDR_DATA) \
+  X( STATUS_OVERVOLTAGE,  DEV_ALL,  ADDR_DATA) \
+  X( STATUS_ZERO_CHECK,   DEV_ALL,  ADDR_DATA) \
+  X( STATUS_ZERO_CORRECT, DEV_ALL,  ADDR_DATA) \
+  X( MODEL,               DEV_ALL,  ADDR_CONFIG) \
+  X( SERIAL,              DEV_ALL,  ADDR_CONFIG) \
+  X( DIG_REV,             DEV_ALL,  ADDR_CONFIG) \
+  X( DISP_REV,            DEV_ALL,  ADDR_CONFIG) \
+  X( BRD_REV,             DEV_ALL,  ADDR_CONFIG) \
+  X( RING_OVERRUNS,       DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_VALUE,       DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_TIME,        DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_COUNT,       DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_MEAN,        DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_RMS,         DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_MIN,         DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_MAX,         DEV_ALL,  ADDR_DATA) \
+  X( HISTORY_P2P,         DEV_ALL,  ADDR_DATA) \
+  X( BURST_SIGMA,         DEV_ALL,  ADDR_DATA) \
+  X( BURST_VALUE,         DEV_ALL,  ADDR_DATA) \
+  X( BURST_TIME,          DEV_ALL,  ADDR_DATA) \
+  X( PSD,                 DEV_ALL,  ADDR_DATA) \
+  X( PSD_FREQUENCY,       DEV_ALL,  ADDR_DATA) \
+  X( PSD_PEAK,            DEV_ALL,  ADDR_DATA) \
+  X( PSD_SEGMENTS,        DEV_ALL,  ADDR_DATA) \
+  X( HISTOGRAM,           DEV_ALL,  ADDR_DATA) \
+  X( HISTOGRAM_AXIS,      DEV_ALL,  ADDR_DATA) \
+  X( HISTOGRAM_CENTER,    DEV_ALL,  ADDR_DATA) \
+  X( HISTOGRAM_COUNT,     DEV_ALL,  ADDR_DATA) \
+  X( HISTOGRAM_OUTSIDE,   DEV_ALL,  ADDR_DATA) \
+  X( SWEEP_POINTS,        DEV_6487, ADDR_DATA) \
+  X( SWEEP_STATE,         DEV_6487, ADDR_DATA) \
+  X( SWEEP_VOLTAGE,       DEV_6487, ADDR_DATA) \
+  X( SWEEP_CURRENT,       DEV_6487, ADDR_DATA) \
+  X( RAMP_VOLTAGE,        DEV_6487, ADDR_DATA) \
+  X( RAMP_PROGRESS,       DEV_6487, ADDR_DATA) \
+  X( RAMP_STATE,          DEV_6487, ADDR_DATA) \
+  X( EXPECTED_RATE,       DEV_ALL,  ADDR_CONFIG) \
+  X( SETUP,               DEV_ALL,  ADDR_CONFIG) \
+  X( CHARGE,              DEV_ALL,  ADDR_DATA) \
+  X( CHARGE_GAPS,         DEV_ALL,  ADDR_DATA) \
+  X( INTERVAL_MEAN,       DEV_ALL,  ADDR_DATA) \
+  X( INTERVAL_JITTER,     DEV_ALL,  ADDR_DATA) \
+  X( INTERVAL_MAX,        DEV_ALL,  ADDR_DATA) \
+  X( ARRIVAL_JITTER,      DEV_ALL,  ADDR_DATA) \
+  X( MISSED_READINGS,     DEV_ALL,  ADDR_DATA) \
+  X( HOST_OUTLIER,        DEV_ALL,  ADDR_DATA) \
+  X( HOST_MEDIAN,         DEV_ALL,  ADDR_DATA) \
+  X( HOST_AVERAGE,        DEV_ALL,  ADDR_DATA) \
+  X( HOST_EXP,            DEV_ALL,  ADDR_DATA) \
+  X( HOST_REJECTED,       DEV_ALL,  ADDR_DATA) \
+  X( RESPONSIVITY,        DEV_ALL,  ADDR_CONFIG) \
+  X( POWER,               DEV_ALL,  ADDR_DATA) \
+  X( FLUX,                DEV_ALL,  ADDR_DATA)
+
+#define GEN_ID(id, dev, addr, readFunc, writeFunc)      id##_CMD,
+#define GEN_METHODS(id, dev, addr, readFunc, writeFunc) { readFunc, writeFunc },
+#define GEN_TAG(id, dev, addr, readFunc, writeFunc) \
+  { #id, dev, addr, CMD_GEN, id##_CMD },
+#define SIMPLE_ID(id, dev, addr, type, cmd_str)         id##_CMD,
+#define SIMPLE_SCPI(id, dev, addr, type, cmd_str)       { type, cmd_str },
+#define SIMPLE_TAG(id, dev, addr, type, cmd_str) \
+  { #id, dev, addr, CMD_SIMPLE, id##_CMD },
+#define CACHE_ID(id, dev, addr)                         id##_CMD,
+#define CACHE_TAG(id, dev, addr) \
+  { #id, dev, addr, CMD_CACHE, id##_CMD },
+
+enum { GEN_COMMANDS(GEN_ID)             GEN_CMD_NUMBER };
+enum { SIMPLE_COMMANDS(SIMPLE_ID)       SIMPLE_CMD_NUMBER };
+enum { CACHE_COMMANDS(CACHE_ID)         CACHE_CMD_NUMBER };
 
-    { SIMPLE_INT32,   "AVER"},                // DIGITAL FILTER
-    { SIMPLE_INT32,   "AVER:COUN"},           // DIGITAL FILTER COUNT
+#define COMMAND_NUMBER (GEN_CMD_NUMBER + SIMPLE_CMD_NUMBER + CACHE_CMD_NUMBER)
 
-    { SIMPLE_FLOAT64, "SOUR:VOLT"},           // VOLTAGE
-    { SIMPLE_INT32,   "SOUR:VOLT:STAT"},      // VOLTAGE STATE
-    { SIMPLE_INT32,   "SOUR:VOLT:INT"},       // VOLTAGE 10V INTERLOCK
-    { SIMPLE_INT32,   "SOUR:VOLT:INT:FAIL"},  // VOLTAGE INTERLOCK STATUS
+static GenCommand genCommandTable[GEN_CMD_NUMBER] = 
+  {
+    GEN_COMMANDS(GEN_METHODS)
+  };
 
-    // { SIMPLE_INT32,   "AVER:"},      // 
-    // { SIMPLE_INT32,   "AVER:"},      // 
+static SimpleCommand simpleCommandTable[SIMPLE_CMD_NUMBER] = 
+  {
+    SIMPLE_COMMANDS(SIMPLE_SCPI)
   };
 
+static Command commandTable[ COMMAND_NUMBER ] = 
+  {
+    GEN_COMMANDS(GEN_TAG)
+    SIMPLE_COMMANDS(SIMPLE_TAG)
+    CACHE_COMMANDS(CACHE_TAG)
+  };
 
-enum { TIMESTAMP_CMD, STATUS_RAW_CMD, STATUS_OVERFLOW_CMD, STATUS_FILTER_CMD, 
-       STATUS_MATH_CMD, STATUS_NULL_CMD, STATUS_LIMITS_CMD, 
-       STATUS_OVERVOLTAGE_CMD, STATUS_ZERO_CHECK_CMD, STATUS_ZERO_CORRECT_CMD,
-       MODEL_CMD, SERIAL_CMD, DIG_REV_CMD, DISP_REV_CMD, BRD_REV_CMD, 
-       CACHE_CMD_NUMBER };
 
-#define COMMAND_NUMBER (GEN_CMD_NUMBER + SIMPLE_CMD_NUMBER + CACHE_CMD_NUMBER)
+// Settings after *RST, assumed until the first refresh
+static const Settings resetSettings = 
+  { 6.0,  1, 1, 0, 10, 1, 0, 1, 0, 60.0 };
 
-enum { CMD_GEN, CMD_SIMPLE, CMD_CACHE };
-enum { DEV_ALL, DEV_6485, DEV_6487};
-static Command commandTable[ COMMAND_NUMBER ] = 
+// nplc, autozero, display, average, count, repeat, median, rangeAuto, 
+// readingOnly; indexed by PROFILE_*
+static const Settings profileTable[PROFILE_CUSTOM] = 
   {
-    { "VOID",                     DEV_ALL,  CMD_GEN,    VOID_CMD                     },
-    { "READ",                     DEV_ALL,  CMD_GEN,    READ_CMD                     },
-    { "RANGE",                    DEV_ALL,  CMD_GEN,    RANGE_CMD                    },
-    { "RANGE_AUTO_ULIMIT",        DEV_ALL,  CMD_GEN,    RANGE_AUTO_ULIMIT_CMD        },
-    { "RANGE_AUTO_LLIMIT",        DEV_ALL,  CMD_GEN,    RANGE_AUTO_LLIMIT_CMD        },
-    { "RATE",                     DEV_ALL,  CMD_GEN,    RATE_CMD                     },
-    { "DIGITAL_FILTER_CONTROL",   DEV_ALL,  CMD_GEN,    DIGITAL_FILTER_CONTROL_CMD   },
-    { "VOLTAGE_RANGE",            DEV_6487, CMD_GEN,    VOLTAGE_RANGE_CMD            },
-    { "VOLTAGE_CURRENT_LIMIT",    DEV_6487, CMD_GEN,    VOLTAGE_CURRENT_LIMIT_CMD    },
-    { "RESET",                    DEV_ALL,  CMD_SIMPLE, RESET_CMD                    },
-    { "RANGE_AUTO",               DEV_ALL,  CMD_SIMPLE, RANGE_AUTO_CMD               },
-    { "ZERO_CHECK",               DEV_ALL,  CMD_SIMPLE, ZERO_CHECK_CMD               },
-    { "ZERO_CORRECT",             DEV_ALL,  CMD_SIMPLE, ZERO_CORRECT_CMD             },
-    { "ZERO_CORRECT_ACQUIRE",     DEV_ALL,  CMD_SIMPLE, ZERO_CORRECT_ACQUIRE_CMD     },
-    { "MEDIAN_FILTER",            DEV_ALL,  CMD_SIMPLE, MEDIAN_FILTER_CMD            },
-    { "MEDIAN_FILTER_RANK",       DEV_ALL,  CMD_SIMPLE, MEDIAN_FILTER_RANK_CMD       },
-    { "DIGITAL_FILTER",           DEV_ALL,  CMD_SIMPLE, DIGITAL_FILTER_CMD           },
-    { "DIGITAL_FILTER_COUNT",     DEV_ALL,  CMD_SIMPLE, DIGITAL_FILTER_COUNT_CMD     },
-    { "VOLTAGE",                  DEV_6487, CMD_SIMPLE, VOLTAGE_CMD                  },
-    { "VOLTAGE_STATE",            DEV_6487, CMD_SIMPLE, VOLTAGE_STATE_CMD            },
-    { "VOLTAGE_TENV_INTERLOCK",   DEV_6487, CMD_SIMPLE, VOLTAGE_10V_INTERLOCK_CMD    },
-    { "VOLTAGE_INTERLOCK_STATUS", DEV_6487, CMD_SIMPLE, VOLTAGE_INTERLOCK_STATUS_CMD },
-    { "MODEL",                    DEV_ALL,  CMD_CACHE,  MODEL_CMD                    },
-    { "SERIAL",                   DEV_ALL,  CMD_CACHE,  SERIAL_CMD                   },
-    { "DIG_REV",                  DEV_ALL,  CMD_CACHE,  DIG_REV_CMD                  },
-    { "DISP_REV",                 DEV_ALL,  CMD_CACHE,  DISP_REV_CMD                 },
-    { "BRD_REV",                  DEV_ALL,  CMD_CACHE,  BRD_REV_CMD                  },
-    { "TIMESTAMP",                DEV_ALL,  CMD_CACHE,  TIMESTAMP_CMD                },
-    { "STATUS_RAW",               DEV_ALL,  CMD_CACHE,  STATUS_RAW_CMD               },
-    { "STATUS_OVERFLOW",          DEV_ALL,  CMD_CACHE,  STATUS_OVERFLOW_CMD          },
-    { "STATUS_FILTER",            DEV_ALL,  CMD_CACHE,  STATUS_FILTER_CMD            },
-    { "STATUS_MATH",              DEV_ALL,  CMD_CACHE,  STATUS_MATH_CMD              },
-    { "STATUS_NULL",              DEV_ALL,  CMD_CACHE,  STATUS_NULL_CMD              },
-    { "STATUS_LIMITS",            DEV_ALL,  CMD_CACHE,  STATUS_LIMITS_CMD            },
-    { "STATUS_OVERVOLTAGE",       DEV_ALL,  CMD_CACHE,  STATUS_OVERVOLTAGE_CMD       },
-    { "STATUS_ZERO_CHECK",        DEV_ALL,  CMD_CACHE,  STATUS_ZERO_CHECK_CMD        },
-    { "STATUS_ZERO_CORRECT",      DEV_ALL,  CMD_CACHE,  STATUS_ZERO_CORRECT_CMD      },
+    { 0.01, 0, 0, 0, 10, 1, 0, 0, 1 },      // MAX_SPEED
+    { 1.0,  1, 1, 0, 10, 1, 0, 1, 0 },      // BALANCED
+    { 6.0,  1, 1, 1, 10, 0, 0, 1, 0 },      // LOW_NOISE
   };
 
+static const char *profileNames[PROFILE_CUSTOM + 1] = 
+  { "MAX_SPEED", "BALANCED", "LOW_NOISE", "CUSTOM" };
+
+// NPLC and repeating filter counts the tuner tries, 0 = filter off
+static const double tuneNplc[] = { 0.01, 0.1, 1.0, 5.0 };
+static const int tuneFilter[] = { 0, 5, 20 };
+
+#define TUNE_NPLCS   (sizeof(tuneNplc) / sizeof(tuneNplc[0]))
+#define TUNE_FILTERS (sizeof(tuneFilter) / sizeof(tuneFilter[0]))
+
 
 
 /****************************************************************************
  * Define public interface methods
  ****************************************************************************/
 int drvAsynKeithley648x(const char *type, const char *myport,
-                        const char *ioport, int ioaddr)
+                        const char *ioport, int ioaddr, int baud)
 {
   int status = asynSuccess;
   Port* pport;
@@ -343,6 +1207,13 @@ int drvAsynKeithley648x(const char *type, const char *myport,
   pport->myport = epicsStrDup(myport);
   pport->ioport = epicsStrDup(ioport);
   pport->ioaddr = ioaddr;
+  pport->lock = epicsMutexMustCreate();
+  pport->deadband = (Deadband*)callocMustSucceed(COMMAND_NUMBER,
+                                                 sizeof(Deadband),
+                                                 "drvAsynKeithley6485");
+  pport->recorder.lock = epicsMutexMustCreate();
+  pport->recorder.autoDump = 1;
+  pport->recorder.armed = 1;
 
   pport->devtype = DEV_ALL;
   if( !strcmp("6485", type))
@@ -357,20 +1228,35 @@ int drvAsynKeithley648x(const char *type, const char *myport,
     }
 
 
-  status = pasynOctetSyncIO->connect(ioport,ioaddr,&pport->pasynUser,NULL);
-  if (status != asynSuccess)
+  if( !strncmp( ioport, REPLAY_PREFIX, strlen(REPLAY_PREFIX)) )
     {
-      errlogPrintf("%s::drvAsynKeithley6485 port %s can't connect "
-                   "to asynCommon on Octet server %s address %d.\n",
-                   driver, myport, ioport, ioaddr);
-      return asynError;
+      pport->replay = replayOpen( ioport + strlen(REPLAY_PREFIX));
+      if( pport->replay == NULL)
+        {
+          errlogPrintf("%s::drvAsynKeithley6485 port %s can't load "
+                       "replay file %s\n", driver, myport, 
+                       ioport + strlen(REPLAY_PREFIX));
+          return asynError;
+        }
+    }
+  else
+    {
+      status = pasynOctetSyncIO->connect(ioport,ioaddr,&pport->pasynUser,NULL);
+      if (status != asynSuccess)
+        {
+          errlogPrintf("%s::drvAsynKeithley6485 port %s can't connect "
+                       "to asynCommon on Octet server %s address %d.\n",
+                       driver, myport, ioport, ioaddr);
+          return asynError;
+        }
     }
 
   /* Create asynUser for asynTrace */
   pport->pasynUserTrace = pasynManager->createAsynUser(0, 0);
   pport->pasynUserTrace->userPvt = pport;
 
-  status = pasynManager->registerPort(myport,ASYN_CANBLOCK,1,0,0);
+  status = pasynManager->registerPort(myport,ASYN_MULTIDEVICE|ASYN_CANBLOCK,
+                                      1,0,0);
   if( status != asynSuccess) 
     {
       errlogPrintf("%s::drvAsynKeithley6485 port %s can't register port\n",
@@ -386,6 +1272,16 @@ int drvAsynKeithley648x(const char *type, const char *myport,
   pInterfaces->octet.pinterface     = (void *)&ifaceOctet;
   pInterfaces->int32.pinterface     = (void *)&ifaceInt32;
   pInterfaces->float64.pinterface   = (void *)&ifaceFloat64;
+  pInterfaces->float64Array.pinterface = (void *)&ifaceFloat64Array;
+  pInterfaces->int32Array.pinterface = (void *)&ifaceInt32Array;
+  pInterfaces->uInt32Digital.pinterface = (void *)&ifaceUInt32Digital;
+
+  /* Define which interfaces can generate interrupts */
+  pInterfaces->int32CanInterrupt    = 1;
+  pInterfaces->float64CanInterrupt  = 1;
+  pInterfaces->float64ArrayCanInterrupt = 1;
+  pInterfaces->int32ArrayCanInterrupt = 1;
+  pInterfaces->uInt32DigitalCanInterrupt = 1;
 
   status = pasynStandardInterfacesBase->initialize(myport, pInterfaces,
                                                    pport->pasynUserTrace, 
@@ -419,14 +1315,36 @@ int drvAsynKeithley648x(const char *type, const char *myport,
     }
   
 
-  /* Identification query */
-  if( writeRead(pport,"*IDN?",inpBuf,sizeof(inpBuf),&eomReason) )
+  /* Identification query, hunting for the serial rate if unanswered */
+  if( writeRead(pport,"*IDN?",inpBuf,sizeof(inpBuf),&eomReason) &&
+      ( pport->replay || findBaud(pport,inpBuf,sizeof(inpBuf)) ) )
     {
       errlogPrintf("%s::drvAsynKeithley6485 port %s failed to "
                    "acquire identification\n", driver, myport);
       return asynError;
     }
+  // keep the reply, inpBuf is reused below
   strcpy(pport->model,inpBuf);
+
+  /* Move instrument and port to the requested serial rate */
+  if( (baud > 0) && !pport->replay)
+    {
+      if( (pport->baud == 0) && 
+          !writeReadTimeout(pport,"SYST:COMM:SER:BAUD?",inpBuf,
+                            sizeof(inpBuf),&eomReason,PROBE_TIMEOUT) )
+        pport->baud = atoi(inpBuf);
+      if( (baud != pport->baud) && negotiateBaud(pport,baud) )
+        errlogPrintf("%s::drvAsynKeithley6485 port %s failed to switch to "
+                     "%d baud, staying at %d\n", driver, myport, baud, 
+                     pport->baud);
+    }
+  /* Fill the settings cache in one transaction */
+  pport->settings = resetSettings;
+  pport->burst.count = 1;
+  if( refreshSettings(pport) )
+    errlogPrintf("%s::drvAsynKeithley6485 port %s failed to read settings, "
+                 "assuming reset values\n", driver, myport);
+
   // char *model, *serial, *dig_rev, *disp_rev, *brd_rev;
   pport->serial = strchr( pport->model, ',');
   pport->serial = strchr( pport->serial + 1, ',');
@@ -448,6 +1366,36 @@ int drvAsynKeithley648x(const char *type, const char *myport,
   pport->data.reading = 0.0;
   pport->data.timestamp = 0;
   pport->data.status.raw = 0;
+  pport->history.period = 1.0;
+  pport->sweep.step = 1.0;
+  pport->sweep.points = 1;
+  pport->ramp.rate = 1.0;
+  pport->setup = -1;
+  pport->charge.maxGap = 10.0;
+
+  pport->acq.ioLock = epicsMutexMustCreate();
+  if( engine && !pport->replay)
+    {
+      /* Hand acquisition to the shared engine */
+      if( engineAdd(pport) )
+        {
+          errlogPrintf("%s::drvAsynKeithley6485 port %s can't join the "
+                       "I/O engine\n", driver, myport);
+          return asynError;
+        }
+    }
+  else
+    {
+      /* Start acquisition and publishing threads, idle until ACQUIRE is set */
+      pport->acq.wake = epicsEventMustCreate(epicsEventEmpty);
+      pport->acq.ready = epicsEventMustCreate(epicsEventEmpty);
+      epicsThreadCreate( "K648xAcquire", epicsThreadPriorityMedium,
+                         epicsThreadGetStackSize(epicsThreadStackMedium),
+                         acquireTask, pport);
+      epicsThreadCreate( "K648xPublish", epicsThreadPriorityMedium,
+                         epicsThreadGetStackSize(epicsThreadStackMedium),
+                         publishTask, pport);
+    }
 
   return asynSuccess;
 }
@@ -455,857 +1403,4725 @@ int drvAsynKeithley648x(const char *type, const char *myport,
 
 
 
-/****************************************************************************
- * Define private read and write parameter methods
- ****************************************************************************/
-
-static asynStatus readDummy(int which, Port *pport, void *data, Type Iface, 
-                            size_t *length, int *eom)
+int drvAsynKeithley648xEngine(int workers)
 {
-  return asynSuccess;
-}
+  int i;
+
+  if( engine)
+    {
+      errlogPrintf("%s::drvAsynKeithley648xEngine engine already running\n",
+                   driver);
+      return asynError;
+    }
+  if( (workers < 1) || (workers > ENGINE_MAX_WORKERS) )
+    {
+      errlogPrintf("%s::drvAsynKeithley648xEngine workers has to be "
+                   "between 1 and %d\n", driver, ENGINE_MAX_WORKERS);
+      return asynError;
+    }
+
+  engine = (Engine*)callocMustSucceed(1,sizeof(Engine),"drvAsynKeithley6485");
+  engine->workers = workers;
+  engine->lock = epicsMutexMustCreate();
+  engine->wake = epicsEventMustCreate(epicsEventEmpty);
+  for( i = 0; i < workers; i++)
+    {
+      engine->ready[i] = epicsEventMustCreate(epicsEventEmpty);
+      epicsThreadCreate( "K648xWorker", epicsThreadPriorityMedium,
+                         epicsThreadGetStackSize(epicsThreadStackMedium),
+                         engineWorker, (void *) (size_t) i);
+    }
+  epicsThreadCreate( "K648xEngine", epicsThreadPriorityMedium,
+                     epicsThreadGetStackSize(epicsThreadStackMedium),
+                     engineTask, NULL);
 
-static asynStatus writeDummy(int which, Port *pport, void *data, Type Iface)
-{
   return asynSuccess;
 }
 
-///
 
-static asynStatus readSimpleData( int which, Port *pport, void *data, 
-                                  Type Iface, size_t *length, int *eom)
+
+
+/* Find a port by name through asyn, it has to be one of ours */
+static Port *findPort(const char *myport, const char *caller)
 {
-  asynStatus status;
-  char outBuf[BUFFER_SIZE];
-  char inpBuf[BUFFER_SIZE];
+  asynUser *pasynUser;
+  asynInterface *pasynInterface;
 
-  int len;
+  pasynUser = pasynManager->createAsynUser( NULL, NULL);
+  pasynInterface = NULL;
+  if( pasynManager->connectDevice( pasynUser, myport, 0) == asynSuccess)
+    {
+      pasynInterface = pasynManager->findInterface( pasynUser, 
+                                                    asynCommonType, 1);
+      pasynManager->disconnect( pasynUser);
+    }
+  pasynManager->freeAsynUser( pasynUser);
+  if( (pasynInterface == NULL) || 
+      (pasynInterface->pinterface != (void *) &ifaceCommon) )
+    {
+      errlogPrintf("%s::%s %s is not a Keithley648x port\n", driver, caller,
+                   myport);
+      return NULL;
+    }
 
-  // Trigger will automatically not work
-  if( simpleCommandTable[which].type != Iface)
-    return asynSuccess;
+  return (Port *) pasynInterface->drvPvt;
+}
 
-  sprintf( outBuf, "%s?", simpleCommandTable[which].cmd_str);
-    
-  status = writeRead( pport, outBuf, inpBuf, BUFFER_SIZE, &pport->data.eom);
-  if( status != asynSuccess)
-    return status;
 
-  switch( Iface)
+int drvAsynKeithley648xDeadband(const char *myport, const char *tag, 
+                                double absolute, double relative, 
+                                double maxRate)
+{
+  Port *pport;
+  Deadband *pdb;
+  epicsFloat64 fval;
+  int i;
+
+  if( (absolute < 0.0) || (relative < 0.0) || (maxRate < 0.0) )
     {
-    case Float64:
-      *((epicsFloat64 *) data) = atof(inpBuf);
-      break;
-    case Int32:
-      *((epicsInt32 *) data) = atoi(inpBuf);
-      break;
-    case Octet:
-      len = strlen( inpBuf);
-      if( len > 39)
-        inpBuf[39] = '\0';
-      strcpy( (char *) data, inpBuf);
+      errlogPrintf("%s::drvAsynKeithley648xDeadband deadbands and rate "
+                   "can't be negative\n", driver);
+      return asynError;
+    }
+
+  pport = findPort( myport, "drvAsynKeithley648xDeadband");
+  if( pport == NULL)
+    return asynError;
+
+  for( i = 0; i < COMMAND_NUMBER; i++)
+    if( !epicsStrCaseCmp( tag, commandTable[i].tag) )
       break;
+  if( i == COMMAND_NUMBER)
+    {
+      errlogPrintf("%s::drvAsynKeithley648xDeadband port %s has no tag %s\n",
+                   driver, myport, tag);
+      return asynError;
+    }
+  // only READ and the cached Float64 tags are called back through deadbands
+  if( !( (commandTable[i].type == CMD_GEN) && 
+         (commandTable[i].id == READ_CMD) ) &&
+      !( (commandTable[i].type == CMD_CACHE) && 
+         (readCache( commandTable[i].id, pport, &fval, Float64, NULL, NULL) 
+          == asynSuccess) ) )
+    {
+      errlogPrintf("%s::drvAsynKeithley648xDeadband port %s tag %s is not a "
+                   "Float64 tag\n", driver, myport, tag);
+      return asynError;
     }
 
+  pdb = &pport->deadband[i];
+  epicsMutexLock( pport->lock);
+  pdb->absolute = absolute;
+  pdb->relative = relative;
+  pdb->minInterval = (maxRate > 0.0) ? 1.0 / maxRate : 0.0;
+  pdb->active = (absolute > 0.0) || (relative > 0.0) || (maxRate > 0.0);
+  pdb->sent = 0;
+  pdb->suppressed = 0;
+  epicsMutexUnlock( pport->lock);
+
   return asynSuccess;
 }
 
-static asynStatus writeSimpleData( int which, Port *pport, void *data, 
-                                    Type Iface)
+
+int drvAsynKeithley648xDump(const char *myport, int count)
 {
-  char outBuf[BUFFER_SIZE];
-  
-  if( simpleCommandTable[which].type == SIMPLE_TRIGGER )
-    sprintf( outBuf, "%s", simpleCommandTable[which].cmd_str);
-  else
-    {
-      if( simpleCommandTable[which].type != Iface )
-        return asynSuccess;
-      
-      switch( simpleCommandTable[which].type & Iface)
-        {
-        case Float64:
-          sprintf( outBuf, "%s %g", simpleCommandTable[which].cmd_str, 
-                   *((epicsFloat64*) data) );
-          break;
-        case Int32:
-          sprintf( outBuf, "%s %d", simpleCommandTable[which].cmd_str, 
-                   *((epicsInt32*) data) );
-          break;
-        case Octet:
-          sprintf( outBuf, "%s %s", simpleCommandTable[which].cmd_str, 
-                   ((char *) data) );
-          break;
-        }
-    }
+  Port *pport;
 
-  return writeOnly( pport, outBuf);
+  pport = findPort( myport, "drvAsynKeithley648xDump");
+  if( pport == NULL)
+    return asynError;
+
+  recorderDump( pport, count);
+
+  return asynSuccess;
 }
 
-////
 
-static asynStatus readCache(int which, Port *pport, void *data, 
-                            Type Iface, size_t *length, int *eom)
+int drvAsynKeithley648xAutoDump(const char *myport, int enable)
 {
-  char *char_cache = NULL;
-  int len;
+  Port *pport;
 
-  switch( Iface)
+  pport = findPort( myport, "drvAsynKeithley648xAutoDump");
+  if( pport == NULL)
+    return asynError;
+
+  epicsMutexLock( pport->recorder.lock);
+  pport->recorder.autoDump = (enable != 0);
+  epicsMutexUnlock( pport->recorder.lock);
+
+  return asynSuccess;
+}
+
+
+
+
+int drvAsynKeithley648xResponse(const char *myport, const char *file)
+{
+  Port *pport;
+  Response *prsp;
+  ResponseTable *ptab, *pold;
+  FILE *fp;
+  char line[BUFFER_SIZE];
+  char *str, *end;
+  double energy, response;
+  int lineNumber = 0;
+
+  pport = findPort( myport, "drvAsynKeithley648xResponse");
+  if( pport == NULL)
+    return asynError;
+
+  fp = fopen( file, "r");
+  if( fp == NULL)
     {
-    case Octet:
-      switch(which)
-        {
-        case MODEL_CMD:
-          char_cache = pport->model;
-          break;
-        case SERIAL_CMD:
-          char_cache = pport->serial;
-          break;
-        case DIG_REV_CMD:
-          char_cache = pport->dig_rev;
-          break;
-        case DISP_REV_CMD:
-          char_cache = pport->disp_rev;
-          break;
-        case BRD_REV_CMD:
-          char_cache = pport->brd_rev;
-          break;
-        }
-      len = strlen(char_cache);
-      if( len < 40)
-        strcpy( (char *) data, char_cache);
-      else // just in case string will overflow the EPICS string size of 40
-        {
-          len = 39;
-          memcpy( (char *) data, char_cache, len);
-          ((char *) data)[len] = '\0';
-        }
-      *length = len;
-      *eom = 0;
-      break;
-    case Float64:
-    //   switch( which)
-    //     {
-    //     }
-      break;
-    case Int32:
-      switch( which)
+      errlogPrintf("%s::drvAsynKeithley648xResponse can't open %s\n",
+                   driver, file);
+      return asynError;
+    }
+
+  ptab = (ResponseTable*) callocMustSucceed( 1, sizeof(ResponseTable), 
+                                             "drvAsynKeithley648xResponse");
+  while( fgets( line, sizeof(line), fp) )
+    {
+      lineNumber++;
+      str = line + strspn( line, " \t");
+      if( (*str == '#') || (*str == '\r') || (*str == '\n') || !*str)
+        continue;
+
+      energy = strtod( str, &end);
+      str = end + strspn( end, " \t,");
+      response = strtod( str, &end);
+      if( (end == str) || (ptab->count == RESPONSE_SIZE) || 
+          ((ptab->count > 0) && 
+           (energy <= ptab->energy[ptab->count - 1])) )
         {
-        case TIMESTAMP_CMD:
-          *(epicsInt32*)data = pport->data.timestamp;
-          break;  
-        case STATUS_RAW_CMD:
-          *(epicsInt32*) data = pport->data.status.raw;
-          break;
-        case STATUS_OVERFLOW_CMD:
-          *(epicsInt32*) data = pport->data.status.bits.overflow;
-          break;
-        case STATUS_FILTER_CMD:
-          *(epicsInt32*) data = pport->data.status.bits.filter_enabled;
-          break;
-        case STATUS_MATH_CMD:
-          *(epicsInt32*) data = pport->data.status.bits.math_enabled;
-          break;
-        case STATUS_NULL_CMD:
-          *(epicsInt32*) data = pport->data.status.bits.null_enabled;
-          break;
-        case STATUS_LIMITS_CMD:
-          if( pport->data.status.bits.limit_test)
-            *(epicsInt32*) data = pport->data.status.bits.limit_result;
-          else
-            *(epicsInt32*) data = 3;
-          break;
-        case STATUS_OVERVOLTAGE_CMD:
-          *(epicsInt32*) data = pport->data.status.bits.overvoltage;
-          break;
-        case STATUS_ZERO_CHECK_CMD:
-          *(epicsInt32*) data = pport->data.status.bits.zero_check_enabled;
-          break;
-        case STATUS_ZERO_CORRECT_CMD:
-          *(epicsInt32*) data = pport->data.status.bits.zero_correct_enabled;
-          break;
+          errlogPrintf("%s::drvAsynKeithley648xResponse %s line %d: expected "
+                       "ascending \"energy responsivity\", at most %d\n",
+                       driver, file, lineNumber, RESPONSE_SIZE);
+          fclose( fp);
+          free( ptab);
+          return asynError;
         }
-      break;
+      ptab->energy[ptab->count] = energy;
+      ptab->response[ptab->count] = response;
+      ptab->count++;
+    }
+  fclose( fp);
+
+  if( ptab->count < 2)
+    {
+      errlogPrintf("%s::drvAsynKeithley648xResponse %s needs two energies "
+                   "at least\n", driver, file);
+      free( ptab);
+      return asynError;
     }
 
+  prsp = &pport->response;
+  epicsMutexLock( pport->lock);
+  pold = prsp->table;
+  prsp->table = ptab;
+  prsp->responsivity = interpolateResponse( ptab, prsp->energy);
+  if( prsp->responsivity <= 0.0)
+    prsp->power = prsp->flux = 0.0;
+  epicsMutexUnlock( pport->lock);
+  free( pold);
+
+  publishFloat64Cache( pport);
+
   return asynSuccess;
 }
 
 
-static asynStatus readSensorReading(int which, Port *pport, void *data, 
-                                    Type Iface, size_t *length, int *eom)
+
+
+int drvAsynKeithley648xBench(const char *myport, const char *tag, 
+                             const char *iface, int loops)
 {
-  asynStatus status;
+  Port *pport;
+  asynUser *pasynUser;
+  epicsTimeStamp start, end;
+  epicsFloat64 fval;
+  epicsInt32 ival;
   char inpBuf[BUFFER_SIZE];
+  size_t nbytes;
+  int i, eom, errors, transactions;
+  double elapsed;
+  asynStatus status;
 
-  char *str, *token[3], *saveptr;
-  int pass;
+  pport = findPort( myport, "drvAsynKeithley648xBench");
+  if( pport == NULL)
+    return asynError;
+  if( iface == NULL)
+    iface = "Float64";
+  if( loops <= 0)
+    loops = 1000;
+
+  for( i = 0; i < COMMAND_NUMBER; i++)
+    if( !epicsStrCaseCmp( tag, commandTable[i].tag) )
+      break;
+  if( i == COMMAND_NUMBER)
+    {
+      errlogPrintf("%s::drvAsynKeithley648xBench port %s has no tag %s\n",
+                   driver, myport, tag);
+      return asynError;
+    }
 
-  status = writeRead( pport, "READ?", inpBuf, BUFFER_SIZE, &pport->data.eom);
+  pasynUser = pasynManager->createAsynUser( NULL, NULL);
+  status = pasynManager->connectDevice( pasynUser, myport, 
+                                        commandTable[i].addr);
+  if( status == asynSuccess)
+    status = create( pport, pasynUser, tag, NULL, NULL);
   if( status != asynSuccess)
-    return status;
+    {
+      errlogPrintf("%s::drvAsynKeithley648xBench port %s can't serve %s\n",
+                   driver, myport, tag);
+      pasynManager->freeAsynUser( pasynUser);
+      return asynError;
+    }
 
-  str = inpBuf;
-  for( pass = 0; pass < 3; pass++, str = NULL)
+  // keep the port's own queue out of the measurement
+  pasynManager->lockPort( pasynUser);
+  epicsMutexLock( pport->lock);
+  transactions = pport->stats.writeReads + pport->stats.writeOnlys;
+  epicsMutexUnlock( pport->lock);
+  errors = 0;
+  epicsTimeGetCurrent( &start);
+  for( i = 0; i < loops; i++)
     {
-      token[pass] = epicsStrtok_r(str, ",", &saveptr);
-      if (token == NULL)
-        break;
+      if( !epicsStrCaseCmp( iface, "Int32") )
+        status = readInt32( pport, pasynUser, &ival);
+      else if( !epicsStrCaseCmp( iface, "Octet") )
+        status = readOctet( pport, pasynUser, inpBuf, BUFFER_SIZE, &nbytes, 
+                            &eom);
+      else
+        status = readFloat64( pport, pasynUser, &fval);
+      if( status != asynSuccess)
+        errors++;
     }
-  if( pass != 3)
-    return asynError;
+  epicsTimeGetCurrent( &end);
+  epicsMutexLock( pport->lock);
+  transactions = pport->stats.writeReads + pport->stats.writeOnlys - 
+    transactions;
+  epicsMutexUnlock( pport->lock);
+  pasynManager->unlockPort( pasynUser);
 
-  pport->data.reading = atof( token[0]);
-  pport->data.timestamp = (int) atof( token[1]);
-  pport->data.status.raw = (int) atof( token[2]);
+  pasynManager->disconnect( pasynUser);
+  pasynManager->freeAsynUser( pasynUser);
 
-  switch( Iface )
+  elapsed = epicsTimeDiffInSeconds( &end, &start);
+  printf("%s %s (%s): %d reads, %.3f us each, %.2f transactions each, "
+         "%d errors\n", myport, tag, iface, loops, elapsed * 1e6 / loops,
+         (double) transactions / loops, errors);
+
+  return asynSuccess;
+}
+
+
+
+
+/* Apply the integration time and filter of a tuner setting in one line */
+static asynStatus tuneApply(Port *pport, const Settings *pset)
+{
+  char outBuf[BUFFER_SIZE];
+  char inpBuf[BUFFER_SIZE];
+  asynStatus status;
+  int eom;
+
+  sprintf( outBuf, "NPLC %g;:AVER:COUN %d;:AVER:TCON %s;:AVER %d;*OPC?",
+           pset->nplc, pset->averageCount, 
+           pset->averageRepeat ? "REP" : "MOV", pset->average);
+  status = writeRead( pport, outBuf, inpBuf, BUFFER_SIZE, &eom);
+  if( status != asynSuccess)
+    return status;
+
+  epicsMutexLock( pport->lock);
+  pport->settings = *pset;
+  epicsMutexUnlock( pport->lock);
+
+  return asynSuccess;
+}
+
+
+/* Take count readings as READ would and measure their standard deviation
+   and rate; called with the line held */
+static asynStatus tuneMeasure(Port *pport, double *value, int count, 
+                              double *sigma, double *rate)
+{
+  char inpBuf[BUFFER_SIZE], *buffer;
+  Reading rd, *prd;
+  epicsTimeStamp start, end;
+  asynStatus status;
+  double mean;
+  int burst, size, taken, n, i, eom;
+
+  burst = burstCount( pport);
+  buffer = (burst > 1) ? pport->burst.buffer : inpBuf;
+  size = (burst > 1) ? BURST_BUFFER : BUFFER_SIZE;
+  prd = (burst > 1) ? pport->burst.readings : &rd;
+
+  // the first reading settles the new setting and is not counted
+  for( taken = -1; taken < count; )
     {
-    case Octet:
-      // only print current value
-      *length = sprintf( (char *) data, "%s", token[0]);
-      *eom = pport->data.eom;
-      break;
-    case Float64:
-      *(epicsFloat64*)data = pport->data.reading;
-      break;
-    case Int32:
-      break;
+      if( taken == 0)
+        epicsTimeGetCurrent( &start);
+      status = writeReadTimeout( pport, "READ?", buffer, size, &eom, 
+                                 TIMEOUT + readingPeriod( pport));
+      if( status != asynSuccess)
+        return status;
+      n = parseReadings( pport, buffer, prd, burst);
+      if( n < 0)
+        return asynError;
+      if( taken < 0)
+        {
+          taken = 0;
+          continue;
+        }
+      for( i = 0; (i < n) && (taken < count); i++)
+        {
+          // an overflow says nothing about the noise
+          if( prd[i].status & 0x1)
+            return asynOverflow;
+          value[taken++] = prd[i].reading;
+        }
     }
+  epicsTimeGetCurrent( &end);
+
+  mean = 0.0;
+  for( i = 0; i < count; i++)
+    mean += value[i];
+  mean /= count;
+  *sigma = 0.0;
+  for( i = 0; i < count; i++)
+    *sigma += (value[i] - mean) * (value[i] - mean);
+  *sigma = sqrt( *sigma / (count - 1));
+  *rate = count / epicsTimeDiffInSeconds( &end, &start);
 
   return asynSuccess;
 }
 
-static asynStatus readRange(int which, Port *pport, void *data, 
-                            Type Iface, size_t *length, int *eom)
+
+int drvAsynKeithley648xTune(const char *myport, double noise, int readings)
 {
-  asynStatus status;
+  Port *pport;
+  asynUser *pasynUser;
+  Settings original, grid[TUNE_NPLCS * TUNE_FILTERS], set;
+  double *value, sigma = 0.0, rate = 0.0, bestRate;
   char inpBuf[BUFFER_SIZE];
+  size_t i, j, j2, points, best;
+  asynStatus status;
+  int found, eom;
 
-  if( Iface == Octet)
-    return asynSuccess;
-
-  switch( which)
+  pport = findPort( myport, "drvAsynKeithley648xTune");
+  if( pport == NULL)
+    return asynError;
+  if( noise <= 0.0)
     {
-    case RANGE_CMD:
-      status = writeRead( pport, ":RANGE?", inpBuf, BUFFER_SIZE, 
-                          &pport->data.eom);
-      break;
-    case RANGE_AUTO_ULIMIT_CMD:
-      status = writeRead( pport, ":RANGE:AUTO:ULIM?", inpBuf, BUFFER_SIZE, 
-                          &pport->data.eom);
-      break;
-    case RANGE_AUTO_LLIMIT_CMD:
-      status = writeRead( pport, ":RANGE:AUTO:LLIM?", inpBuf, BUFFER_SIZE, 
-                          &pport->data.eom);
-      break;
-    default:
+      errlogPrintf("%s::drvAsynKeithley648xTune port %s needs a noise "
+                   "target in amperes\n", driver, myport);
       return asynError;
     }
-  if( status != asynSuccess)
-    return status;
+  if( readings < 2)
+    readings = TUNE_READINGS;
 
-  if( Iface == Float64)
-    {
-      double val;
+  epicsMutexLock( pport->lock);
+  original = pport->settings;
+  epicsMutexUnlock( pport->lock);
 
-      val = atof( inpBuf);
-      if( val == 0.0)
-        return asynError;
+  // every combination, fastest expected first
+  points = 0;
+  for( i = 0; i < TUNE_NPLCS; i++)
+    for( j = 0; j < TUNE_FILTERS; j++)
+      {
+        set = original;
+        set.nplc = tuneNplc[i];
+        set.average = (tuneFilter[j] > 0);
+        set.averageCount = set.average ? tuneFilter[j] : 
+          original.averageCount;
+        set.averageRepeat = set.average ? 1 : original.averageRepeat;
+        for( j2 = points++; 
+             (j2 > 0) && (expectedRate( &grid[j2 - 1]) < expectedRate( &set)); 
+             j2--)
+          grid[j2] = grid[j2 - 1];
+        grid[j2] = set;
+      }
 
-      *(epicsFloat64*) data = val;
+  pasynUser = pasynManager->createAsynUser( NULL, NULL);
+  if( pasynManager->connectDevice( pasynUser, myport, ADDR_CONFIG) )
+    {
+      pasynManager->freeAsynUser( pasynUser);
+      return asynError;
     }
-  else if( Iface == Int32)
+  value = (double *) callocMustSucceed( readings, sizeof(double), 
+                                        "drvAsynKeithley648xTune");
+
+  // hold the port's queue and the acquisition off the line for the run
+  pasynManager->lockPort( pasynUser);
+  epicsMutexLock( pport->acq.ioLock);
+  printf("%s tuning for %g A over %d readings each\n", myport, noise, 
+         readings);
+  // a signal that moves during the run is taken for noise
+  if( (writeRead( pport, "SYST:ZCH?", inpBuf, BUFFER_SIZE, &eom) == 
+       asynSuccess) && !atoi( inpBuf) )
+    printf("%s has zero check off, the input must be steady\n", myport);
+  printf("      NPLC  filter     noise (A)  rate (/s)\n");
+
+  // the measured rate decides, the expected one only orders the table
+  found = 0;
+  best = 0;
+  bestRate = 0.0;
+  for( i = 0; i < points; i++)
     {
-      char *p;
-
-      p = strchr( inpBuf, 'E');
-      if(p == NULL)
-        return asynError;
-      p++;
-      *(epicsInt32*) data = 9 + atoi(p) ;
+      status = tuneApply( pport, &grid[i]);
+      if( status == asynSuccess)
+        status = tuneMeasure( pport, value, readings, &sigma, &rate);
+      printf("  %8g  %6d  ", grid[i].nplc, 
+             grid[i].average ? grid[i].averageCount : 0);
+      if( status == asynOverflow)
+        printf("    overflow\n");
+      else if( status != asynSuccess)
+        printf("       error\n");
+      else
+        {
+          printf("%12.4e  %9.2f%s\n", sigma, rate, 
+                 (sigma <= noise) ? "  passes" : "");
+          if( (sigma <= noise) && (!found || (rate > bestRate)) )
+            {
+              found = 1;
+              best = i;
+              bestRate = rate;
+            }
+        }
+    }
+  if( found && (tuneApply( pport, &grid[best]) == asynSuccess) )
+    printf("%s keeps NPLC %g, filter %d at %.2f readings/s\n", myport,
+           grid[best].nplc, grid[best].average ? grid[best].averageCount : 0,
+           bestRate);
+  else
+    {
+      printf("%s found no setting below %g A, restoring NPLC %g\n", myport,
+             noise, original.nplc);
+      found = 0;
+      tuneApply( pport, &original);
     }
+  refreshSettings( pport);
+  epicsMutexUnlock( pport->acq.ioLock);
+  pasynManager->unlockPort( pasynUser);
+
+  free( value);
+  pasynManager->disconnect( pasynUser);
+  pasynManager->freeAsynUser( pasynUser);
+
+  return found ? asynSuccess : asynError;
+}
 
+
+
+
+/****************************************************************************
+ * Define private read and write parameter methods
+ ****************************************************************************/
+
+static asynStatus readDummy(int which, Port *pport, void *data, Type Iface, 
+                            size_t *length, int *eom)
+{
   return asynSuccess;
 }
 
+static asynStatus writeDummy(int which, Port *pport, void *data, Type Iface)
+{
+  return asynSuccess;
+}
 
-static asynStatus writeRange( int which, Port *pport, void *data, Type Iface)
+///
+
+static asynStatus readSimpleData( int which, Port *pport, void *data, 
+                                  Type Iface, size_t *length, int *eom)
 {
+  asynStatus status;
   char outBuf[BUFFER_SIZE];
-  int value;
+  char inpBuf[BUFFER_SIZE];
+  int eomReason;
 
-  if( Iface != Int32)
+  int len;
+
+  // Trigger will automatically not work
+  if( simpleCommandTable[which].type != Iface)
     return asynSuccess;
 
-  value = *((epicsInt32*) data);
-  if( (value < 0) || (value > 7) )
-    return asynError;
+  sprintf( outBuf, "%s?", simpleCommandTable[which].cmd_str);
     
-  switch( which)
+  status = writeRead( pport, outBuf, inpBuf, BUFFER_SIZE, &eomReason);
+  if( status != asynSuccess)
+    return status;
+
+  switch( Iface)
     {
-    case RANGE_CMD:
-      sprintf( outBuf, ":RANGE 2.0e%d", -9 + value );
-      break;
-    case RANGE_AUTO_ULIMIT_CMD:
-      sprintf( outBuf, ":RANGE:AUTO:ULIM 2.0e%d", -9 + value );
+    case Float64:
+      *((epicsFloat64 *) data) = atof(inpBuf);
       break;
-    case RANGE_AUTO_LLIMIT_CMD:
-      sprintf( outBuf, ":RANGE:AUTO:LLIM 2.0e%d", -9 + value );
+    case Int32:
+      *((epicsInt32 *) data) = atoi(inpBuf);
+      noteSimpleSetting( pport, which, *((epicsInt32 *) data) );
+      break;
+    case Octet:
+      len = strlen( inpBuf);
+      if( len > 39)
+        inpBuf[39] = '\0';
+      strcpy( (char *) data, inpBuf);
       break;
     default:
-      return asynError;
+      break;
+    }
+
+  return asynSuccess;
+}
+
+static asynStatus writeSimpleData( int which, Port *pport, void *data, 
+                                    Type Iface)
+{
+  asynStatus status;
+  char outBuf[BUFFER_SIZE];
+  
+  if( simpleCommandTable[which].type == SIMPLE_TRIGGER )
+    sprintf( outBuf, "%s", simpleCommandTable[which].cmd_str);
+  else
+    {
+      if( simpleCommandTable[which].type != Iface )
+        return asynSuccess;
+      
+      switch( simpleCommandTable[which].type & Iface)
+        {
+        case Float64:
+          sprintf( outBuf, "%s %g", simpleCommandTable[which].cmd_str, 
+                   *((epicsFloat64*) data) );
+          break;
+        case Int32:
+          sprintf( outBuf, "%s %d", simpleCommandTable[which].cmd_str, 
+                   *((epicsInt32*) data) );
+          break;
+        case Octet:
+          sprintf( outBuf, "%s %s", simpleCommandTable[which].cmd_str, 
+                   ((char *) data) );
+          break;
+        }
+    }
+
+  status = writeOnly( pport, outBuf);
+  if( (status == asynSuccess) && (Iface != Octet) )
+    noteSimpleSetting( pport, which, (Iface == Float64) ? 
+                       *((epicsFloat64*) data) : *((epicsInt32*) data) );
+
+  return status;
+}
+
+////
+
+static asynStatus readCache(int which, Port *pport, void *data, 
+                            Type Iface, size_t *length, int *eom)
+{
+  char *char_cache = NULL;
+  asynStatus status = asynSuccess;
+  int len;
+
+  epicsMutexLock( pport->lock);
+  switch( Iface)
+    {
+    case Octet:
+      switch(which)
+        {
+        case MODEL_CMD:
+          char_cache = pport->model;
+          break;
+        case SERIAL_CMD:
+          char_cache = pport->serial;
+          break;
+        case DIG_REV_CMD:
+          char_cache = pport->dig_rev;
+          break;
+        case DISP_REV_CMD:
+          char_cache = pport->disp_rev;
+          break;
+        case BRD_REV_CMD:
+          char_cache = pport->brd_rev;
+          break;
+        }
+      len = strlen(char_cache);
+      if( len < 40)
+        strcpy( (char *) data, char_cache);
+      else // just in case string will overflow the EPICS string size of 40
+        {
+          len = 39;
+          memcpy( (char *) data, char_cache, len);
+          ((char *) data)[len] = '\0';
+        }
+      *length = len;
+      *eom = 0;
+      break;
+    case Float64:
+      switch( which)
+        {
+        case HISTORY_MEAN_CMD:
+          *(epicsFloat64*) data = pport->history.stats.mean;
+          break;
+        case HISTORY_RMS_CMD:
+          *(epicsFloat64*) data = pport->history.stats.rms;
+          break;
+        case HISTORY_MIN_CMD:
+          *(epicsFloat64*) data = pport->history.stats.min;
+          break;
+        case HISTORY_MAX_CMD:
+          *(epicsFloat64*) data = pport->history.stats.max;
+          break;
+        case HISTORY_P2P_CMD:
+          *(epicsFloat64*) data = pport->history.stats.p2p;
+          break;
+        case BURST_SIGMA_CMD:
+          *(epicsFloat64*) data = pport->burst.sigma;
+          break;
+        case PSD_PEAK_CMD:
+          *(epicsFloat64*) data = pport->spectrum.peak;
+          break;
+        case HISTOGRAM_CENTER_CMD:
+          *(epicsFloat64*) data = pport->histogram.center;
+          break;
+        case EXPECTED_RATE_CMD:
+          *(epicsFloat64*) data = expectedRate( &pport->settings);
+          break;
+        case CHARGE_CMD:
+          *(epicsFloat64*) data = pport->charge.total;
+          break;
+        case RAMP_VOLTAGE_CMD:
+          *(epicsFloat64*) data = pport->ramp.voltage;
+          break;
+        case RAMP_PROGRESS_CMD:
+          if( pport->ramp.target == pport->ramp.from)
+            *(epicsFloat64*) data = 100.0;
+          else
+            *(epicsFloat64*) data = 100.0 * 
+              (pport->ramp.voltage - pport->ramp.from) / 
+              (pport->ramp.target - pport->ramp.from);
+          break;
+        case INTERVAL_MEAN_CMD:
+          *(epicsFloat64*) data = pport->cadence.mean;
+          break;
+        case HOST_OUTLIER_CMD:
+          *(epicsFloat64*) data = pport->filter.outlierOut;
+          break;
+        case HOST_MEDIAN_CMD:
+          *(epicsFloat64*) data = pport->filter.medianOut;
+          break;
+        case HOST_AVERAGE_CMD:
+          *(epicsFloat64*) data = pport->filter.averageOut;
+          break;
+        case HOST_EXP_CMD:
+          *(epicsFloat64*) data = pport->filter.expOut;
+          break;
+        case RESPONSIVITY_CMD:
+          *(epicsFloat64*) data = pport->response.responsivity;
+          break;
+        case POWER_CMD:
+          *(epicsFloat64*) data = pport->response.power;
+          break;
+        case FLUX_CMD:
+          *(epicsFloat64*) data = pport->response.flux;
+          break;
+        case INTERVAL_JITTER_CMD:
+          *(epicsFloat64*) data = sqrt( pport->cadence.variance);
+          break;
+        case INTERVAL_MAX_CMD:
+          *(epicsFloat64*) data = pport->cadence.maxGap;
+          break;
+        case ARRIVAL_JITTER_CMD:
+          *(epicsFloat64*) data = sqrt( pport->cadence.arrivalVariance);
+          break;
+        default:
+          status = asynError;
+          break;
+        }
+      break;
+    case Float64Array:
+      switch( which)
+        {
+        case HISTORY_VALUE_CMD:
+          *length = historySnapshot( pport, (double *) data, NULL, *length);
+          break;
+        case HISTORY_TIME_CMD:
+          *length = historySnapshot( pport, NULL, (double *) data, *length);
+          break;
+        case BURST_VALUE_CMD:
+          if( *length > (size_t) pport->burst.length)
+            *length = pport->burst.length;
+          memcpy( data, pport->burst.value, *length * sizeof(double));
+          break;
+        case BURST_TIME_CMD:
+          if( *length > (size_t) pport->burst.length)
+            *length = pport->burst.length;
+          memcpy( data, pport->burst.time, *length * sizeof(double));
+          break;
+        case PSD_CMD:
+          if( *length > (size_t) pport->spectrum.length)
+            *length = pport->spectrum.length;
+          memcpy( data, pport->spectrum.psd, *length * sizeof(double));
+          break;
+        case PSD_FREQUENCY_CMD:
+          if( *length > (size_t) pport->spectrum.length)
+            *length = pport->spectrum.length;
+          memcpy( data, pport->spectrum.freq, *length * sizeof(double));
+          break;
+        case HISTOGRAM_AXIS_CMD:
+          if( !pport->histogram.placed)
+            *length = 0;
+          else if( *length > (size_t) pport->histogram.bins)
+            *length = pport->histogram.bins;
+          memcpy( data, pport->histogram.axis, *length * sizeof(double));
+          break;
+        case SWEEP_VOLTAGE_CMD:
+          if( *length > pport->sweep.count)
+            *length = pport->sweep.count;
+          memcpy( data, pport->sweep.voltage, *length * sizeof(double));
+          break;
+        case SWEEP_CURRENT_CMD:
+          if( *length > pport->sweep.count)
+            *length = pport->sweep.count;
+          memcpy( data, pport->sweep.current, *length * sizeof(double));
+          break;
+        default:
+          *length = 0;
+          break;
+        }
+      break;
+    case Int32:
+      switch( which)
+        {
+        case TIMESTAMP_CMD:
+          *(epicsInt32*)data = pport->data.timestamp;
+          break;  
+        case STATUS_RAW_CMD:
+          *(epicsInt32*) data = pport->data.status.raw;
+          break;
+        case STATUS_OVERFLOW_CMD:
+          *(epicsInt32*) data = pport->data.status.bits.overflow;
+          break;
+        case STATUS_FILTER_CMD:
+          *(epicsInt32*) data = pport->data.status.bits.filter_enabled;
+          break;
+        case STATUS_MATH_CMD:
+          *(epicsInt32*) data = pport->data.status.bits.math_enabled;
+          break;
+        case STATUS_NULL_CMD:
+          *(epicsInt32*) data = pport->data.status.bits.null_enabled;
+          break;
+        case STATUS_LIMITS_CMD:
+          if( pport->data.status.bits.limit_test)
+            *(epicsInt32*) data = pport->data.status.bits.limit_result;
+          else
+            *(epicsInt32*) data = 3;
+          break;
+        case STATUS_OVERVOLTAGE_CMD:
+          *(epicsInt32*) data = pport->data.status.bits.overvoltage;
+          break;
+        case STATUS_ZERO_CHECK_CMD:
+          *(epicsInt32*) data = pport->data.status.bits.zero_check_enabled;
+          break;
+        case STATUS_ZERO_CORRECT_CMD:
+          *(epicsInt32*) data = pport->data.status.bits.zero_correct_enabled;
+          break;
+        case RING_OVERRUNS_CMD:
+          *(epicsInt32*) data = pport->ring.overruns;
+          break;
+        case HISTORY_COUNT_CMD:
+          *(epicsInt32*) data = (pport->history.count < HISTORY_SIZE) ?
+            pport->history.count : HISTORY_SIZE;
+          break;
+        case SWEEP_POINTS_CMD:
+          *(epicsInt32*) data = pport->sweep.points;
+          break;
+        case SWEEP_STATE_CMD:
+          *(epicsInt32*) data = pport->sweep.state;
+          break;
+        case RAMP_STATE_CMD:
+          *(epicsInt32*) data = pport->ramp.state;
+          break;
+        case SETUP_CMD:
+          *(epicsInt32*) data = pport->setup;
+          break;
+        case CHARGE_GAPS_CMD:
+          *(epicsInt32*) data = pport->charge.gaps;
+          break;
+        case MISSED_READINGS_CMD:
+          *(epicsInt32*) data = pport->cadence.missed;
+          break;
+        case HOST_REJECTED_CMD:
+          *(epicsInt32*) data = pport->filter.rejected;
+          break;
+        case PSD_SEGMENTS_CMD:
+          *(epicsInt32*) data = pport->spectrum.segments;
+          break;
+        case HISTOGRAM_COUNT_CMD:
+          *(epicsInt32*) data = pport->histogram.count;
+          break;
+        case HISTOGRAM_OUTSIDE_CMD:
+          *(epicsInt32*) data = pport->histogram.outside;
+          break;
+        default:
+          status = asynError;
+          break;
+        }
+      break;
+    case Int32Array:
+      switch( which)
+        {
+        case HISTOGRAM_CMD:
+          if( *length > (size_t) pport->histogram.bins)
+            *length = pport->histogram.bins;
+          memcpy( data, pport->histogram.counts, *length * sizeof(epicsInt32));
+          break;
+        default:
+          *length = 0;
+          break;
+        }
+      break;
+    }
+  epicsMutexUnlock( pport->lock);
+
+  return status;
+}
+
+
+static asynStatus readSensorReading(int which, Port *pport, void *data, 
+                                    Type Iface, size_t *length, int *eom)
+{
+  asynStatus status;
+  char inpBuf[BUFFER_SIZE], *buffer;
+  Reading rd, *prd;
+  double mean = 0.0;
+  int count, size, n, i, eomReason;
+
+  // the acquisition thread keeps the cache current, so only report it
+  if( pport->acq.enabled)
+    {
+      epicsMutexLock( pport->lock);
+      switch( Iface )
+        {
+        case Octet:
+          *length = sprintf( (char *) data, "%+.6E", pport->data.reading);
+          *eom = 0;
+          break;
+        case Float64:
+          *(epicsFloat64*)data = pport->data.reading;
+          break;
+        default:
+          break;
+        }
+      epicsMutexUnlock( pport->lock);
+      return asynSuccess;
+    }
+
+  count = burstCount( pport);
+  if( count > 1)
+    {
+      // the burst buffers are shared with the acquisition thread
+      epicsMutexLock( pport->acq.ioLock);
+      buffer = pport->burst.buffer;
+      size = BURST_BUFFER;
+      prd = pport->burst.readings;
+    }
+  else
+    {
+      buffer = inpBuf;
+      size = BUFFER_SIZE;
+      prd = &rd;
+    }
+
+  status = writeReadTimeout( pport, "READ?", buffer, size, &eomReason, 
+                             TIMEOUT + readingPeriod(pport));
+  n = (status == asynSuccess) ? parseReadings( pport, buffer, prd, count) : 0;
+  for( i = 0; i < n; i++)
+    processReading( pport, &prd[i]);
+  if( count > 1)
+    {
+      epicsMutexLock( pport->lock);
+      mean = pport->burst.mean;
+      epicsMutexUnlock( pport->lock);
+      epicsMutexUnlock( pport->acq.ioLock);
+    }
+  if( status != asynSuccess)
+    return status;
+  if( n < 0)
+    return asynError;
+
+  publishReadings( pport);
+
+  switch( Iface )
+    {
+    case Octet:
+      // only print current value, parsing left it first in inpBuf
+      if( count > 1)
+        *length = sprintf( (char *) data, "%+.6E", mean);
+      else
+        *length = sprintf( (char *) data, "%s", inpBuf);
+      *eom = eomReason;
+      break;
+    case Float64:
+      *(epicsFloat64*)data = (count > 1) ? mean : rd.reading;
+      break;
+    default:
+      break;
+    }
+
+  return asynSuccess;
+}
+
+static asynStatus readRange(int which, Port *pport, void *data, 
+                            Type Iface, size_t *length, int *eom)
+{
+  asynStatus status;
+  char inpBuf[BUFFER_SIZE];
+  int eomReason;
+
+  if( Iface == Octet)
+    return asynSuccess;
+
+  switch( which)
+    {
+    case RANGE_CMD:
+      status = writeRead( pport, ":RANGE?", inpBuf, BUFFER_SIZE, 
+                          &eomReason);
+      break;
+    case RANGE_AUTO_ULIMIT_CMD:
+      status = writeRead( pport, ":RANGE:AUTO:ULIM?", inpBuf, BUFFER_SIZE, 
+                          &eomReason);
+      break;
+    case RANGE_AUTO_LLIMIT_CMD:
+      status = writeRead( pport, ":RANGE:AUTO:LLIM?", inpBuf, BUFFER_SIZE, 
+                          &eomReason);
+      break;
+    default:
+      return asynError;
+    }
+  if( status != asynSuccess)
+    return status;
+
+  if( Iface == Float64)
+    {
+      double val;
+
+      val = atof( inpBuf);
+      if( val == 0.0)
+        return asynError;
+
+      *(epicsFloat64*) data = val;
+    }
+  else if( Iface == Int32)
+    {
+      char *p;
+
+      p = strchr( inpBuf, 'E');
+      if(p == NULL)
+        return asynError;
+      p++;
+      *(epicsInt32*) data = 9 + atoi(p) ;
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeRange( int which, Port *pport, void *data, Type Iface)
+{
+  char outBuf[BUFFER_SIZE];
+  int value;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  value = *((epicsInt32*) data);
+  if( (value < 0) || (value > 7) )
+    return asynError;
+    
+  switch( which)
+    {
+    case RANGE_CMD:
+      sprintf( outBuf, ":RANGE 2.0e%d", -9 + value );
+      break;
+    case RANGE_AUTO_ULIMIT_CMD:
+      sprintf( outBuf, ":RANGE:AUTO:ULIM 2.0e%d", -9 + value );
+      break;
+    case RANGE_AUTO_LLIMIT_CMD:
+      sprintf( outBuf, ":RANGE:AUTO:LLIM 2.0e%d", -9 + value );
+      break;
+    default:
+      return asynError;
+    }
+
+  return writeOnly( pport, outBuf);
+}
+
+
+static asynStatus readRate(int which, Port *pport, void *data, 
+                           Type Iface, size_t *length, int *eom)
+{
+  asynStatus status;
+  char inpBuf[BUFFER_SIZE];
+  int eomReason;
+
+  double val;
+  int rate;
+
+  if( Iface != ((which == NPLC_CMD) ? Float64 : Int32) )
+    return asynSuccess;
+
+  status = writeRead( pport, ":NPLC?", inpBuf, BUFFER_SIZE, &eomReason);
+  if( status != asynSuccess)
+    return status;
+
+  val = atof( inpBuf);
+  epicsMutexLock( pport->lock);
+  pport->settings.nplc = val;
+  epicsMutexUnlock( pport->lock);
+  publishFloat64Cache( pport);
+
+  if( which == NPLC_CMD)
+    {
+      *((epicsFloat64*) data) = val;
+      return asynSuccess;
+    }
+
+  if( val > 1.0)
+    rate = 0; // SLOW
+  else if( val > 0.1)
+    rate = 1; // MEDIUM
+  else
+    rate = 2; // FAST
+  
+  *((epicsInt32*) data) = rate;
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeRate( int which, Port *pport, void *data, Type Iface)
+{
+  asynStatus status;
+  char outBuf[BUFFER_SIZE];
+  int rate;
+  double val;
+
+  if( which == NPLC_CMD)
+    {
+      if( Iface != Float64)
+        return asynSuccess;
+
+      // at most one second of integration
+      val = *((epicsFloat64*) data);
+      if( (val < 0.01) || (val > pport->settings.lineFrequency) )
+        return asynError;
+    }
+  else
+    {
+      if( Iface != Int32)
+        return asynSuccess;
+
+      rate = *((epicsInt32*) data);
+      if( (rate < 0) || (rate > 2) )
+        return asynError;
+
+      switch( rate)
+        {
+        case 0:
+          val = 6.0;
+          break;
+        case 1:
+          val = 1.0;
+          break;
+        case 2:
+          val = 0.1;
+          break;
+        default:
+          val = 1.0;
+          break;
+        }
+    }
+
+  sprintf( outBuf, ":NPLC %g", val );
+  status = writeOnly( pport, outBuf);
+  if( status != asynSuccess)
+    return status;
+
+  epicsMutexLock( pport->lock);
+  pport->settings.nplc = val;
+  epicsMutexUnlock( pport->lock);
+  publishFloat64Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readVoltageSettings(int which, Port *pport, void *data, Type Iface, 
+                                      size_t *length, int *eom)
+{
+  asynStatus status;
+  char inpBuf[BUFFER_SIZE];
+  int eomReason;
+
+  double val;
+
+  if(( which != VOLTAGE_RANGE_CMD) && ( which != VOLTAGE_CURRENT_LIMIT_CMD))
+    return asynError;
+  if( Iface == Octet)
+    return asynSuccess;
+
+  if( which == VOLTAGE_RANGE_CMD)
+    status = writeRead( pport, "SOUR:VOLT:RANGE?", inpBuf, BUFFER_SIZE, 
+                        &eomReason);
+  else
+    status = writeRead( pport, "SOUR:VOLT:ILIM?", inpBuf, BUFFER_SIZE, 
+                        &eomReason);
+  if( status != asynSuccess)
+    return status;
+
+  val = atof( inpBuf);
+  if( val == 0.0)
+    return asynError;
+
+  if( Iface == Float64)
+    {
+      *((epicsFloat64*) data) = val;
+    }
+  else if( Iface == Int32)
+    {
+      if( which == VOLTAGE_RANGE_CMD)
+        {
+          if( val == 10.0)
+            *((epicsInt32*) data) = 0;
+          else if( val == 50.0)
+            *((epicsInt32*) data) = 1;
+          else if( val == 500.0)
+            *((epicsInt32*) data) = 2;
+        }
+      else
+        {
+          if( val == 2.5e-5)
+            *((epicsInt32*) data) = 0;
+          else if( val == 2.5e-4)
+            *((epicsInt32*) data) = 1;
+          else if( val == 2.5e-3)
+            *((epicsInt32*) data) = 2;
+          else if( val == 2.5e-2)
+            *((epicsInt32*) data) = 3;
+        }
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeVoltageSettings( int which, Port *pport, void *data, Type Iface)
+{
+  char outBuf[BUFFER_SIZE];
+  int value;
+
+  if(( which != VOLTAGE_RANGE_CMD) && ( which != VOLTAGE_CURRENT_LIMIT_CMD))
+    return asynError;
+  if( Iface != Int32)
+    return asynSuccess;
+
+  value = *((epicsInt32*) data);
+  if( which == VOLTAGE_RANGE_CMD) 
+    {
+      if( (value < 0) || (value > 2) )
+        return asynError;
+
+      if( value == 0)
+        value = 10;
+      else if( value == 1)
+        value = 50;
+      else 
+        value = 500;
+   
+      sprintf( outBuf, "SOUR:VOLT:RANGE %d", value );
+    }
+  else
+    {
+      if( (value < 0) || (value > 3) )
+        return asynError;
+
+      sprintf( outBuf, "SOUR:VOLT:ILIM 2.5e%d", value - 5 );
+    }
+
+  return writeOnly( pport, outBuf);
+}
+
+
+static asynStatus readCommon(int which, Port *pport, void *data, 
+                             Type Iface, size_t *length, int *eom)
+{
+  asynStatus status;
+  char inpBuf[BUFFER_SIZE];
+  int eomReason;
+
+  int val = 0;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  switch(which)
+    {
+    case DIGITAL_FILTER_CONTROL_CMD:
+      status = writeRead( pport, "AVER:TCON?", inpBuf, BUFFER_SIZE, 
+                          &eomReason);
+
+      if( status != asynSuccess)
+        return status;
+      if( !strcmp( "MOV", inpBuf) )
+        val = 0;
+      else if( !strcmp( "REP", inpBuf) )
+        val = 1;
+      else
+        return asynError;
+      epicsMutexLock( pport->lock);
+      pport->settings.averageRepeat = val;
+      epicsMutexUnlock( pport->lock);
+      publishFloat64Cache( pport);
+      break;
+    }
+  
+  *((epicsInt32*) data) = val;
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeCommon( int which, Port *pport, void *data, Type Iface)
+{
+  asynStatus status;
+  char outBuf[BUFFER_SIZE];
+  int val;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  val = *((epicsInt32*) data);
+  switch( which)
+    {
+    case DIGITAL_FILTER_CONTROL_CMD:
+      if( !val)
+        sprintf( outBuf, "AVER:TCON MOV" );
+      else if(val == 1)
+        sprintf( outBuf, "AVER:TCON REP" );
+      else
+        return asynError;
+      break;
+    default:
+      return asynError;
+    }
+
+  status = writeOnly( pport, outBuf);
+  if( status != asynSuccess)
+    return status;
+
+  epicsMutexLock( pport->lock);
+  pport->settings.averageRepeat = val;
+  epicsMutexUnlock( pport->lock);
+  publishFloat64Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readReplay(int which, Port *pport, void *data, 
+                             Type Iface, size_t *length, int *eom)
+{
+  if( pport->replay == NULL)
+    return asynError;
+  if( Iface != Float64)
+    return asynSuccess;
+
+  *((epicsFloat64*) data) = pport->replay->speed;
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeReplay( int which, Port *pport, void *data, Type Iface)
+{
+  Replay *prep = pport->replay;
+  epicsTimeStamp now;
+  double speed, elapsed;
+
+  if( prep == NULL)
+    return asynError;
+  if( Iface != Float64)
+    return asynSuccess;
+
+  speed = *((epicsFloat64*) data);
+  if( speed < 0.0)
+    return asynError;
+
+  epicsMutexLock( prep->lock);
+  // rebase the pass start so the next record keeps its place in the pace
+  epicsTimeGetCurrent( &now);
+  prep->start = now;
+  if( speed > 0.0)
+    {
+      elapsed = prep->records[prep->next].timestamp - 
+        prep->records[0].timestamp;
+      epicsTimeAddSeconds( &prep->start, -elapsed / speed);
+    }
+  prep->speed = speed;
+  epicsMutexUnlock( prep->lock);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readAcquire(int which, Port *pport, void *data, 
+                              Type Iface, size_t *length, int *eom)
+{
+  switch( which)
+    {
+    case ACQUIRE_CMD:
+      if( Iface != Int32)
+        return asynSuccess;
+      *((epicsInt32*) data) = pport->acq.enabled;
+      break;
+    case ACQUIRE_PERIOD_CMD:
+      if( Iface != Float64)
+        return asynSuccess;
+      *((epicsFloat64*) data) = pport->acq.period;
+      break;
+    default:
+      return asynError;
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeAcquire( int which, Port *pport, void *data, Type Iface)
+{
+  switch( which)
+    {
+    case ACQUIRE_CMD:
+      if( Iface != Int32)
+        return asynSuccess;
+      pport->acq.enabled = ( *((epicsInt32*) data) != 0);
+      break;
+    case ACQUIRE_PERIOD_CMD:
+      if( Iface != Float64)
+        return asynSuccess;
+      if( *((epicsFloat64*) data) < 0.0)
+        return asynError;
+      pport->acq.period = *((epicsFloat64*) data);
+      break;
+    default:
+      return asynError;
+    }
+
+  // let a waiting acquisition thread pick up the change right away
+  epicsEventSignal( pport->acq.wake);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readHistory(int which, Port *pport, void *data, 
+                              Type Iface, size_t *length, int *eom)
+{
+  switch( which)
+    {
+    case HISTORY_PERIOD_CMD:
+      if( Iface != Float64)
+        return asynSuccess;
+      *((epicsFloat64*) data) = pport->history.period;
+      break;
+    case HISTORY_RESET_CMD:
+      break;
+    default:
+      return asynError;
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeHistory( int which, Port *pport, void *data, Type Iface)
+{
+  switch( which)
+    {
+    case HISTORY_PERIOD_CMD:
+      if( Iface != Float64)
+        return asynSuccess;
+      if( *((epicsFloat64*) data) < 0.0)
+        return asynError;
+      pport->history.period = *((epicsFloat64*) data);
+      break;
+    case HISTORY_RESET_CMD:
+      if( Iface != Int32)
+        return asynSuccess;
+      epicsMutexLock( pport->lock);
+      pport->history.count = 0;
+      epicsMutexUnlock( pport->lock);
+      break;
+    default:
+      return asynError;
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus readSweep(int which, Port *pport, void *data, 
+                            Type Iface, size_t *length, int *eom)
+{
+  double val;
+
+  switch( which)
+    {
+    case SWEEP_START_CMD:
+      val = pport->sweep.start;
+      break;
+    case SWEEP_STOP_CMD:
+      val = pport->sweep.stop;
+      break;
+    case SWEEP_STEP_CMD:
+      val = pport->sweep.step;
+      break;
+    case SWEEP_DELAY_CMD:
+      val = pport->sweep.delay;
+      break;
+    case SWEEP_RUN_CMD:
+      if( Iface == Int32)
+        *((epicsInt32*) data) = (pport->sweep.state == SWEEP_RUNNING);
+      return asynSuccess;
+    default:
+      return asynError;
+    }
+
+  if( Iface == Float64)
+    *((epicsFloat64*) data) = val;
+
+  return asynSuccess;
+}
+
+
+static asynStatus runSweep(Port *pport)
+{
+  Sweep *psw = &pport->sweep;
+  char outBuf[BUFFER_SIZE];
+  char inpBuf[BUFFER_SIZE];
+  char *str, *token, *saveptr;
+  size_t size, n;
+  double nplc, timeout;
+  int eom, field;
+  asynStatus status;
+
+  // enough for READ,TIME,STAT,VSO of every point at 16 characters each
+  size = SWEEP_MAX_POINTS * 4 * 16;
+  if( psw->buffer == NULL)
+    psw->buffer = (char *) mallocMustSucceed( size, "drvAsynKeithley6485");
+
+  status = writeRead( pport, ":NPLC?", inpBuf, BUFFER_SIZE, &eom);
+  if( status != asynSuccess)
+    return status;
+  nplc = atof( inpBuf);
+
+  // autozero can triple the integration time of each point
+  timeout = TIMEOUT + psw->points * (psw->delay + 3.0 * nplc / 50.0 + 0.05);
+
+  sprintf( outBuf, "SOUR:VOLT:SWE:STAR %g", psw->start);
+  if( (status = writeOnly( pport, outBuf)) != asynSuccess)
+    return status;
+  sprintf( outBuf, "SOUR:VOLT:SWE:STOP %g", psw->stop);
+  if( (status = writeOnly( pport, outBuf)) != asynSuccess)
+    return status;
+  sprintf( outBuf, "SOUR:VOLT:SWE:STEP %g", psw->step);
+  if( (status = writeOnly( pport, outBuf)) != asynSuccess)
+    return status;
+  sprintf( outBuf, "SOUR:VOLT:SWE:DEL %g", psw->delay);
+  if( (status = writeOnly( pport, outBuf)) != asynSuccess)
+    return status;
+
+  // from here on every exit goes through the restore below
+  status = writeOnly( pport, "FORM:ELEM READ,TIME,STAT,VSO");
+  if( status == asynSuccess)
+    status = writeOnly( pport, "TRAC:CLE");
+  if( status == asynSuccess)
+    status = writeOnly( pport, "SOUR:VOLT:SWE:INIT");
+  if( status == asynSuccess)
+    status = writeOnly( pport, "INIT");
+  if( status == asynSuccess)
+    status = writeReadTimeout( pport, "*OPC?", inpBuf, BUFFER_SIZE, &eom, 
+                               timeout);
+  if( status == asynSuccess)
+    status = writeReadTimeout( pport, "TRAC:DATA?", psw->buffer, size, &eom,
+                               timeout);
+
+  // always go back to the elements and count readSensorReading expects,
+  // the sweep leaves TRIG:COUN at its number of points
+  writeOnly( pport, pport->settings.readingOnly ? "FORM:ELEM READ" : 
+             "FORM:ELEM READ,TIME,STAT");
+  sprintf( outBuf, "TRIG:COUN %d", burstCount( pport));
+  writeOnly( pport, outBuf);
+  if( status != asynSuccess)
+    return status;
+
+  n = 0;
+  field = 0;
+  str = psw->buffer;
+  while( (token = epicsStrtok_r( str, ",", &saveptr)) != NULL)
+    {
+      str = NULL;
+      if( field == 0)
+        psw->current[n] = atof( token);
+      else if( field == 3)
+        {
+          psw->voltage[n] = atof( token);
+          if( ++n == SWEEP_MAX_POINTS)
+            break;
+        }
+      field = (field + 1) % 4;
+    }
+  if( n == 0)
+    return asynError;
+
+  epicsMutexLock( pport->lock);
+  psw->count = n;
+  epicsMutexUnlock( pport->lock);
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeSweep( int which, Port *pport, void *data, Type Iface)
+{
+  Sweep *psw = &pport->sweep;
+  asynStatus status;
+  double val;
+  int points;
+
+  if( which == SWEEP_RUN_CMD)
+    {
+      if( (Iface != Int32) || !*((epicsInt32*) data) )
+        return asynSuccess;
+
+      psw->state = SWEEP_RUNNING;
+      publishInt32Cache( pport);
+
+      // keep the acquisition thread off the line for the whole sweep
+      epicsMutexLock( pport->acq.ioLock);
+      status = runSweep( pport);
+      epicsMutexUnlock( pport->acq.ioLock);
+
+      psw->state = (status == asynSuccess) ? SWEEP_DONE : SWEEP_FAILED;
+      publishInt32Cache( pport);
+      if( status == asynSuccess)
+        {
+          publishArray( pport, SWEEP_VOLTAGE_CMD, psw->voltage, psw->count);
+          publishArray( pport, SWEEP_CURRENT_CMD, psw->current, psw->count);
+        }
+      return status;
+    }
+
+  if( Iface != Float64)
+    return asynSuccess;
+
+  val = *((epicsFloat64*) data);
+  switch( which)
+    {
+    case SWEEP_START_CMD:
+      psw->start = val;
+      break;
+    case SWEEP_STOP_CMD:
+      psw->stop = val;
+      break;
+    case SWEEP_STEP_CMD:
+      if( val == 0.0)
+        return asynError;
+      psw->step = val;
+      break;
+    case SWEEP_DELAY_CMD:
+      if( val < 0.0)
+        return asynError;
+      psw->delay = val;
+      break;
+    default:
+      return asynError;
+    }
+
+  points = (int) floor( fabs( (psw->stop - psw->start) / psw->step) + 1e-9) + 1;
+  psw->points = (points > SWEEP_MAX_POINTS) ? SWEEP_MAX_POINTS : points;
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readBurst(int which, Port *pport, void *data, 
+                            Type Iface, size_t *length, int *eom)
+{
+  if( Iface == Int32)
+    *((epicsInt32*) data) = burstCount( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeBurst( int which, Port *pport, void *data, Type Iface)
+{
+  char outBuf[BUFFER_SIZE];
+  asynStatus status;
+  int count;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  count = *((epicsInt32*) data);
+  if( (count < 1) || (count > BURST_MAX) )
+    return asynError;
+
+  // the acquisition thread may be using the burst buffers
+  epicsMutexLock( pport->acq.ioLock);
+  sprintf( outBuf, "TRIG:COUN %d", count);
+  status = writeOnly( pport, outBuf);
+  if( status == asynSuccess)
+    setBurstCount( pport, count);
+  epicsMutexUnlock( pport->acq.ioLock);
+
+  return status;
+}
+
+
+static asynStatus readSpectrum(int which, Port *pport, void *data, 
+                               Type Iface, size_t *length, int *eom)
+{
+  if( Iface == Int32)
+    *((epicsInt32*) data) = pport->spectrum.segment;
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeSpectrum( int which, Port *pport, void *data, 
+                                 Type Iface)
+{
+  Spectrum *pspc = &pport->spectrum;
+  int segment;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  // a power of two the history can fill
+  segment = *((epicsInt32*) data);
+  if( (segment != 0) && ((segment < PSD_MIN_SEGMENT) || 
+                         (segment > HISTORY_SIZE) || 
+                         (segment & (segment - 1))) )
+    return asynError;
+
+  epicsMutexLock( pport->lock);
+  pspc->segment = segment;
+  pspc->segments = 0;
+  pspc->length = 0;
+  pspc->peak = 0.0;
+  epicsMutexUnlock( pport->lock);
+
+  publishFloat64Cache( pport);
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readHistogram(int which, Port *pport, void *data, 
+                                Type Iface, size_t *length, int *eom)
+{
+  Histogram *phst = &pport->histogram;
+
+  epicsMutexLock( pport->lock);
+  switch( which)
+    {
+    case HISTOGRAM_BINS_CMD:
+      if( Iface == Int32)
+        *((epicsInt32*) data) = phst->bins;
+      break;
+    case HISTOGRAM_WIDTH_CMD:
+      // the width in use once the bins are placed
+      if( Iface == Float64)
+        *((epicsFloat64*) data) = phst->placed ? phst->binWidth : phst->width;
+      break;
+    case HISTOGRAM_RESET_CMD:
+      break;
+    default:
+      epicsMutexUnlock( pport->lock);
+      return asynError;
+    }
+  epicsMutexUnlock( pport->lock);
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeHistogram( int which, Port *pport, void *data, 
+                                  Type Iface)
+{
+  Histogram *phst = &pport->histogram;
+
+  epicsMutexLock( pport->lock);
+  switch( which)
+    {
+    case HISTOGRAM_BINS_CMD:
+      if( (Iface != Int32) || (*((epicsInt32*) data) < 0) || 
+          (*((epicsInt32*) data) > HISTOGRAM_BINS) )
+        {
+          epicsMutexUnlock( pport->lock);
+          return asynError;
+        }
+      phst->bins = *((epicsInt32*) data);
+      break;
+    case HISTOGRAM_WIDTH_CMD:
+      if( (Iface != Float64) || (*((epicsFloat64*) data) < 0.0) )
+        {
+          epicsMutexUnlock( pport->lock);
+          return asynError;
+        }
+      phst->width = *((epicsFloat64*) data);
+      break;
+    case HISTOGRAM_RESET_CMD:
+      if( Iface != Int32)
+        {
+          epicsMutexUnlock( pport->lock);
+          return asynSuccess;
+        }
+      break;
+    default:
+      epicsMutexUnlock( pport->lock);
+      return asynError;
+    }
+  resetHistogram( phst);
+  epicsMutexUnlock( pport->lock);
+
+  publishFloat64Cache( pport);
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readRamp(int which, Port *pport, void *data, 
+                           Type Iface, size_t *length, int *eom)
+{
+  switch( which)
+    {
+    case RAMP_TARGET_CMD:
+      if( Iface == Float64)
+        *((epicsFloat64*) data) = pport->ramp.target;
+      break;
+    case RAMP_RATE_CMD:
+      if( Iface == Float64)
+        *((epicsFloat64*) data) = pport->ramp.rate;
+      break;
+    case RAMP_STOP_CMD:
+      break;
+    default:
+      return asynError;
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeRamp( int which, Port *pport, void *data, Type Iface)
+{
+  Ramp *prmp = &pport->ramp;
+  double val;
+
+  switch( which)
+    {
+    case RAMP_TARGET_CMD:
+      if( Iface != Float64)
+        return asynSuccess;
+      val = *((epicsFloat64*) data);
+      epicsMutexLock( pport->lock);
+      // a new target mid-ramp carries on from the voltage reached
+      if( prmp->state == RAMP_RUNNING)
+        prmp->from = prmp->voltage;
+      prmp->target = val;
+      prmp->stop = 0;
+      prmp->state = RAMP_RUNNING;
+      epicsMutexUnlock( pport->lock);
+      if( prmp->wake == NULL)
+        {
+          prmp->wake = epicsEventMustCreate( epicsEventEmpty);
+          epicsThreadCreate( "K648xRamp", epicsThreadPriorityMedium,
+                             epicsThreadGetStackSize(epicsThreadStackMedium),
+                             (EPICSTHREADFUNC) rampTask, pport);
+        }
+      epicsEventSignal( prmp->wake);
+      break;
+    case RAMP_RATE_CMD:
+      if( Iface != Float64)
+        return asynSuccess;
+      val = *((epicsFloat64*) data);
+      if( val <= 0.0)
+        return asynError;
+      epicsMutexLock( pport->lock);
+      prmp->rate = val;
+      epicsMutexUnlock( pport->lock);
+      break;
+    case RAMP_STOP_CMD:
+      if( (Iface != Int32) || (prmp->wake == NULL) )
+        return asynSuccess;
+      epicsMutexLock( pport->lock);
+      prmp->stop = 1;
+      epicsMutexUnlock( pport->lock);
+      epicsEventSignal( prmp->wake);
+      break;
+    default:
+      return asynError;
+    }
+
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+/* Step the source voltage towards the ramp target between readings */
+static void rampTask(void *arg)
+{
+  Port *pport = (Port *) arg;
+  Ramp *prmp = &pport->ramp;
+  char outBuf[BUFFER_SIZE];
+  char inpBuf[BUFFER_SIZE];
+  epicsTimeStamp last, now;
+  double step, next;
+  asynStatus status;
+  int eom, state;
+
+  for(;;)
+    {
+      epicsEventWait( prmp->wake);
+      epicsMutexLock( pport->lock);
+      state = prmp->state;
+      epicsMutexUnlock( pport->lock);
+      if( state != RAMP_RUNNING)
+        continue;
+
+      // start from what the source puts out now
+      epicsMutexLock( pport->acq.ioLock);
+      status = writeRead( pport, "SOUR:VOLT?", inpBuf, BUFFER_SIZE, &eom);
+      epicsMutexUnlock( pport->acq.ioLock);
+      epicsMutexLock( pport->lock);
+      if( status == asynSuccess)
+        prmp->from = prmp->voltage = atof( inpBuf);
+      else
+        prmp->state = RAMP_FAILED;
+      epicsMutexUnlock( pport->lock);
+
+      epicsTimeGetCurrent( &last);
+      while( status == asynSuccess)
+        {
+          publishFloat64Cache( pport);
+
+          epicsMutexLock( pport->lock);
+          if( prmp->stop)
+            prmp->state = RAMP_STOPPED;
+          if( prmp->voltage == prmp->target)
+            prmp->state = RAMP_DONE;
+          state = prmp->state;
+          epicsMutexUnlock( pport->lock);
+          if( state != RAMP_RUNNING)
+            break;
+
+          // woken early only by a stop or a new target
+          epicsEventWaitWithTimeout( prmp->wake, RAMP_STEP_PERIOD);
+          epicsTimeGetCurrent( &now);
+
+          epicsMutexLock( pport->lock);
+          if( prmp->stop)
+            {
+              epicsMutexUnlock( pport->lock);
+              continue;
+            }
+          step = prmp->rate * epicsTimeDiffInSeconds( &now, &last);
+          if( fabs( prmp->target - prmp->voltage) <= step)
+            next = prmp->target;
+          else
+            next = prmp->voltage + 
+              ((prmp->target > prmp->voltage) ? step : -step);
+          epicsMutexUnlock( pport->lock);
+          last = now;
+
+          sprintf( outBuf, "SOUR:VOLT %g", next);
+          epicsMutexLock( pport->acq.ioLock);
+          status = writeOnly( pport, outBuf);
+          epicsMutexUnlock( pport->acq.ioLock);
+
+          epicsMutexLock( pport->lock);
+          if( status == asynSuccess)
+            prmp->voltage = next;
+          else
+            prmp->state = RAMP_FAILED;
+          epicsMutexUnlock( pport->lock);
+        }
+
+      publishFloat64Cache( pport);
+      publishInt32Cache( pport);
+    }
+}
+
+
+static asynStatus readProfile(int which, Port *pport, void *data, 
+                              Type Iface, size_t *length, int *eom)
+{
+  asynStatus status;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  status = refreshSettings( pport);
+  if( status != asynSuccess)
+    return status;
+
+  epicsMutexLock( pport->lock);
+  *((epicsInt32*) data) = matchProfile( &pport->settings);
+  epicsMutexUnlock( pport->lock);
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeProfile( int which, Port *pport, void *data, Type Iface)
+{
+  const Settings *pprof;
+  char outBuf[2 * BUFFER_SIZE];
+  char inpBuf[BUFFER_SIZE];
+  double lineFrequency;
+  int profile, eom;
+  asynStatus status;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  profile = *((epicsInt32*) data);
+  if( (profile < 0) || (profile >= PROFILE_CUSTOM) )
+    return asynError;
+  pprof = &profileTable[profile];
+
+  // one line, so no reading is taken with half of the profile applied
+  sprintf( outBuf, "DISP:ENAB %d;:SYST:AZER %d;:NPLC %g;:AVER:COUN %d;"
+           ":AVER:TCON %s;:AVER %d;:MED %d;:RANGE:AUTO %d;:FORM:ELEM %s;*OPC?",
+           pprof->display, pprof->autozero, pprof->nplc, pprof->averageCount,
+           pprof->averageRepeat ? "REP" : "MOV", pprof->average, 
+           pprof->median, pprof->rangeAuto, 
+           pprof->readingOnly ? "READ" : "READ,TIME,STAT");
+  status = writeRead( pport, outBuf, inpBuf, BUFFER_SIZE, &eom);
+  if( status != asynSuccess)
+    {
+      // find out how much of the line the instrument took
+      refreshSettings( pport);
+      return status;
+    }
+
+  epicsMutexLock( pport->lock);
+  lineFrequency = pport->settings.lineFrequency;
+  pport->settings = *pprof;
+  pport->settings.lineFrequency = lineFrequency;
+  epicsMutexUnlock( pport->lock);
+  publishFloat64Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readSetup(int which, Port *pport, void *data, 
+                            Type Iface, size_t *length, int *eom)
+{
+  if( Iface == Int32)
+    *((epicsInt32*) data) = pport->setup;
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeSetup( int which, Port *pport, void *data, Type Iface)
+{
+  char outBuf[BUFFER_SIZE];
+  char inpBuf[BUFFER_SIZE];
+  asynStatus status;
+  int slot, eom;
+
+  if( Iface != Int32)
+    return asynSuccess;
+
+  slot = *((epicsInt32*) data);
+  if( (slot < 0) || (slot >= SETUP_SLOTS) )
+    return asynError;
+
+  switch( which)
+    {
+    case SETUP_SAVE_CMD:
+      sprintf( outBuf, "*SAV %d", slot);
+      status = writeOnly( pport, outBuf);
+      break;
+    case SETUP_RECALL_CMD:
+      // *OPC? holds the reply until the whole setup is in force
+      sprintf( outBuf, "*RCL %d;*OPC?", slot);
+      status = writeRead( pport, outBuf, inpBuf, BUFFER_SIZE, &eom);
+      if( status == asynSuccess)
+        status = refreshSettings( pport);
+      break;
+    default:
+      return asynError;
+    }
+  if( status != asynSuccess)
+    return status;
+
+  epicsMutexLock( pport->lock);
+  pport->setup = slot;
+  epicsMutexUnlock( pport->lock);
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readCharge(int which, Port *pport, void *data, 
+                             Type Iface, size_t *length, int *eom)
+{
+  switch( which)
+    {
+    case CHARGE_RUN_CMD:
+      if( Iface == Int32)
+        *((epicsInt32*) data) = pport->charge.running;
+      break;
+    case CHARGE_RESET_CMD:
+      break;
+    case CHARGE_GAP_CMD:
+      if( Iface == Float64)
+        *((epicsFloat64*) data) = pport->charge.maxGap;
+      break;
+    default:
+      return asynError;
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeCharge( int which, Port *pport, void *data, Type Iface)
+{
+  Charge *pchg = &pport->charge;
+
+  epicsMutexLock( pport->lock);
+  switch( which)
+    {
+    case CHARGE_RUN_CMD:
+      if( Iface != Int32)
+        break;
+      // the first reading after a start only opens an interval
+      if( !pchg->running)
+        pchg->valid = 0;
+      pchg->running = ( *((epicsInt32*) data) != 0);
+      break;
+    case CHARGE_RESET_CMD:
+      if( Iface != Int32)
+        break;
+      pchg->total = 0.0;
+      pchg->gaps = 0;
+      pchg->valid = 0;
+      break;
+    case CHARGE_GAP_CMD:
+      if( Iface != Float64)
+        break;
+      if( *((epicsFloat64*) data) < 0.0)
+        {
+          epicsMutexUnlock( pport->lock);
+          return asynError;
+        }
+      pchg->maxGap = *((epicsFloat64*) data);
+      break;
+    default:
+      epicsMutexUnlock( pport->lock);
+      return asynError;
+    }
+  epicsMutexUnlock( pport->lock);
+
+  publishFloat64Cache( pport);
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readInterval(int which, Port *pport, void *data, 
+                               Type Iface, size_t *length, int *eom)
+{
+  if( which != INTERVAL_RESET_CMD)
+    return asynError;
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeInterval( int which, Port *pport, void *data, 
+                                 Type Iface)
+{
+  if( which != INTERVAL_RESET_CMD)
+    return asynError;
+  if( Iface != Int32)
+    return asynSuccess;
+
+  epicsMutexLock( pport->lock);
+  memset( &pport->cadence, 0, sizeof(Cadence));
+  epicsMutexUnlock( pport->lock);
+
+  publishFloat64Cache( pport);
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readEnergy(int which, Port *pport, void *data, 
+                             Type Iface, size_t *length, int *eom)
+{
+  if( Iface == Float64)
+    *((epicsFloat64*) data) = pport->response.energy;
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeEnergy( int which, Port *pport, void *data, 
+                               Type Iface)
+{
+  Response *prsp = &pport->response;
+  double energy;
+
+  if( Iface != Float64)
+    return asynSuccess;
+
+  energy = *((epicsFloat64*) data);
+  if( energy <= 0.0)
+    return asynError;
+
+  epicsMutexLock( pport->lock);
+  prsp->energy = energy;
+  prsp->responsivity = interpolateResponse( prsp->table, energy);
+  if( prsp->responsivity <= 0.0)
+    prsp->power = prsp->flux = 0.0;
+  epicsMutexUnlock( pport->lock);
+
+  publishFloat64Cache( pport);
+
+  return asynSuccess;
+}
+
+
+static asynStatus readFilter(int which, Port *pport, void *data, 
+                             Type Iface, size_t *length, int *eom)
+{
+  switch( which)
+    {
+    case HOST_OUTLIER_SIGMA_CMD:
+      if( Iface == Float64)
+        *((epicsFloat64*) data) = pport->filter.outlierSigma;
+      break;
+    case HOST_MEDIAN_WINDOW_CMD:
+      if( Iface == Int32)
+        *((epicsInt32*) data) = pport->filter.medianWindow;
+      break;
+    case HOST_AVERAGE_WINDOW_CMD:
+      if( Iface == Int32)
+        *((epicsInt32*) data) = pport->filter.averageWindow;
+      break;
+    case HOST_EXP_TIME_CMD:
+      if( Iface == Float64)
+        *((epicsFloat64*) data) = pport->filter.expTime;
+      break;
+    case HOST_FILTER_RESET_CMD:
+      break;
+    default:
+      return asynError;
+    }
+
+  return asynSuccess;
+}
+
+
+static asynStatus writeFilter( int which, Port *pport, void *data, 
+                               Type Iface)
+{
+  Filter *pflt = &pport->filter;
+  double fval = 0.0;
+  int ival = 0;
+
+  if( Iface == Float64)
+    fval = *((epicsFloat64*) data);
+  else if( Iface == Int32)
+    ival = *((epicsInt32*) data);
+  else
+    return asynSuccess;
+
+  epicsMutexLock( pport->lock);
+  switch( which)
+    {
+    case HOST_OUTLIER_SIGMA_CMD:
+    case HOST_EXP_TIME_CMD:
+      if( (Iface != Float64) || (fval < 0.0) )
+        {
+          epicsMutexUnlock( pport->lock);
+          return asynError;
+        }
+      if( which == HOST_OUTLIER_SIGMA_CMD)
+        pflt->outlierSigma = fval;
+      else
+        pflt->expTime = fval;
+      break;
+    case HOST_MEDIAN_WINDOW_CMD:
+    case HOST_AVERAGE_WINDOW_CMD:
+      if( (Iface != Int32) || (ival < 0) || (ival > FILTER_WINDOW) )
+        {
+          epicsMutexUnlock( pport->lock);
+          return asynError;
+        }
+      if( which == HOST_MEDIAN_WINDOW_CMD)
+        pflt->medianWindow = ival;
+      else
+        pflt->averageWindow = ival;
+      break;
+    case HOST_FILTER_RESET_CMD:
+      break;
+    default:
+      epicsMutexUnlock( pport->lock);
+      return asynError;
+    }
+  resetFilter( pflt);
+  epicsMutexUnlock( pport->lock);
+
+  publishFloat64Cache( pport);
+  publishInt32Cache( pport);
+
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private interface asynCommon methods
+ ****************************************************************************/
+static void report(void* ppvt,FILE* fp,int details)
+{
+  Port* pport = (Port*)ppvt;
+  int i, ioErrors, writeReads, writeOnlys;
+
+  fprintf( fp, "Keithley648x port: %s\n", pport->myport);
+  if( details)
+    {
+      fprintf( fp, "    server:     %s\n", pport->ioport);
+      fprintf( fp, "    address:    %d\n", pport->ioaddr);
+      if( pport->baud)
+        fprintf( fp, "    baud:       %d\n", pport->baud);
+      if( pport->replay)
+        {
+          fprintf( fp, "    replay:     %d records, next %d, pass %d, "
+                   "speed %g\n", pport->replay->count, pport->replay->next,
+                   pport->replay->passes, pport->replay->speed);
+        }
+      fprintf( fp, "    acquire:    %s, period %g s (instrument %g s), "
+               "%d readings, %d errors\n", (pport->acq.enabled)?"ON":"OFF", 
+               pport->acq.period, readingPeriod( pport), pport->acq.readings,
+               pport->acq.errors);
+      if( pport->acq.pasynUserQueue)
+        fprintf( fp, "    engine:     worker %d of %d, %d ports, %d requests, "
+                 "%d skipped\n", pport->acq.worker, engine->workers, 
+                 engine->nports, engine->requests, engine->skipped);
+      fprintf( fp, "    ring:       %u queued, %d published in %d batches "
+               "(max %d), %d overruns\n", 
+               pport->ring.head - pport->ring.tail, pport->ring.published,
+               pport->ring.batches, pport->ring.maxBatch, 
+               pport->ring.overruns);
+      fprintf( fp, "    history:    %u readings, published every %g s, "
+               "%s statistics\n", pport->history.count, 
+               pport->history.period, k648xReduceKernel());
+      if( pport->burst.count > 1)
+        fprintf( fp, "    burst:      %d readings per READ?, mean %g, "
+                 "sigma %g\n", pport->burst.count, pport->burst.mean,
+                 pport->burst.sigma);
+      if( pport->spectrum.segment)
+        fprintf( fp, "    spectrum:   segments of %d readings, %d averaged, "
+                 "peak at %g Hz\n", pport->spectrum.segment, 
+                 pport->spectrum.segments, pport->spectrum.peak);
+      if( pport->histogram.bins)
+        fprintf( fp, "    histogram:  %d bins of %g A around %g A, %u "
+                 "readings, %d outside\n", pport->histogram.bins,
+                 pport->histogram.binWidth, pport->histogram.center,
+                 pport->histogram.count, pport->histogram.outside);
+      if( pport->ramp.wake)
+        fprintf( fp, "    ramp:       state %d, %g V to %g V at %g V/s\n",
+                 pport->ramp.state, pport->ramp.voltage, pport->ramp.target,
+                 pport->ramp.rate);
+      fprintf( fp, "    charge:     %s, %g C, %d gaps (longer than %g s)\n",
+               (pport->charge.running)?"ON":"OFF", pport->charge.total,
+               pport->charge.gaps, pport->charge.maxGap);
+      fprintf( fp, "    cadence:    interval %g s, jitter %g s, arrival "
+               "jitter %g s, max %g s, %d missed\n", pport->cadence.mean,
+               sqrt( pport->cadence.variance), 
+               sqrt( pport->cadence.arrivalVariance), 
+               pport->cadence.maxGap, pport->cadence.missed);
+      fprintf( fp, "    filter:     outlier %g sigma, median %d, average %d, "
+               "exponential %g s, %d rejected\n", pport->filter.outlierSigma,
+               pport->filter.medianWindow, pport->filter.averageWindow,
+               pport->filter.expTime, pport->filter.rejected);
+      // drvAsynKeithley648xResponse swaps the table under the lock
+      epicsMutexLock( pport->lock);
+      if( pport->response.table)
+        fprintf( fp, "    response:   %d energies, %g eV, %g A/W\n",
+                 pport->response.table->count, pport->response.energy,
+                 pport->response.responsivity);
+      epicsMutexUnlock( pport->lock);
+      fprintf( fp, "    settings:   NPLC %g, autozero %s, display %s, "
+               "filter %s, %s, profile %s, %.1f readings/s expected\n",
+               pport->settings.nplc, (pport->settings.autozero)?"ON":"OFF",
+               (pport->settings.display)?"ON":"OFF", 
+               (pport->settings.average)?"ON":"OFF",
+               (pport->settings.readingOnly)?"READ":"READ,TIME,STAT",
+               profileNames[matchProfile( &pport->settings)],
+               expectedRate( &pport->settings));
+      if( pport->setup >= 0)
+        fprintf( fp, "    setup:      memory %d last saved or recalled\n",
+                 pport->setup);
+      for( i = 0; i < COMMAND_NUMBER; i++)
+        if( pport->deadband[i].active)
+          fprintf( fp, "    deadband:   %s absolute %g, relative %g, "
+                   "every %g s, %d suppressed\n", commandTable[i].tag, 
+                   pport->deadband[i].absolute, pport->deadband[i].relative,
+                   pport->deadband[i].minInterval, 
+                   pport->deadband[i].suppressed);
+      fprintf( fp, "    recorder:   %u transactions, auto dump %s, "
+               "%d dumps\n", pport->recorder.count, 
+               (pport->recorder.autoDump)?"ON":"OFF", pport->recorder.dumps);
+      epicsMutexLock( pport->lock);
+      ioErrors = pport->stats.ioErrors;
+      writeReads = pport->stats.writeReads;
+      writeOnlys = pport->stats.writeOnlys;
+      epicsMutexUnlock( pport->lock);
+      fprintf( fp, "    ioErrors:   %d\n", ioErrors);
+      fprintf( fp, "    writeReads: %d\n", writeReads);
+      fprintf( fp, "    writeOnlys: %d\n", writeOnlys);
+      fprintf( fp, "    support %s initialized\n",(pport->init)?"IS":"IS NOT");
+    }
+
+}
+
+static asynStatus connect(void* ppvt,asynUser* pasynUser)
+{
+  pasynManager->exceptionConnect(pasynUser);
+  return asynSuccess;
+}
+
+static asynStatus disconnect(void* ppvt,asynUser* pasynUser)
+{
+  pasynManager->exceptionDisconnect(pasynUser);
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private interface asynDrvUser methods
+ ****************************************************************************/
+static asynStatus create(void* ppvt, asynUser *pasynUser, const char *drvInfo, 
+                         const char **pptypeName, size_t *psize)
+{
+  Port* pport=(Port*)ppvt;
+  
+  int i;
+  
+  for(i = 0; i < COMMAND_NUMBER; i++) 
+    if( !epicsStrCaseCmp( drvInfo, commandTable[i].tag) ) 
+      {
+        if( (commandTable[i].dev != DEV_ALL) && 
+            (commandTable[i].dev != pport->devtype) )
+          {
+            errlogPrintf("%s::create port %s failed as tag %s is for different "
+                         "device\n", driver, pport->myport, drvInfo);
+            pasynUser->reason = 0;
+            return asynError;
+          }
+        pasynUser->reason = i;
+        break;
+      }
+  if( i == COMMAND_NUMBER ) 
+    {
+      errlogPrintf("%s::create port %s failed to find tag %s\n",
+                   driver, pport->myport, drvInfo);
+      pasynUser->reason = 0;
+      return asynError;
+    }
+  
+  return asynSuccess;
+}
+
+static asynStatus gettype(void* ppvt,asynUser* pasynUser,
+                          const char** pptypeName,size_t* psize)
+{
+  if( pptypeName ) 
+    *pptypeName = NULL;
+  if( psize ) 
+    *psize = 0;
+
+  return asynSuccess;
+}
+
+static asynStatus destroy(void* ppvt,asynUser* pasynUser)
+{
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private interface asynFloat64 methods
+ ****************************************************************************/
+static asynStatus writeFloat64(void* ppvt,asynUser* pasynUser,
+                               epicsFloat64 value)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+   switch( commandTable[which].type )
+    {
+    case CMD_GEN:
+      return genCommandTable[id].writeFunc(id, pport, &value, Float64);
+      break;
+    case CMD_SIMPLE:
+      return writeSimpleData( id, pport, &value, Float64);
+      break;
+    }
+
+  return asynSuccess;
+}
+
+static asynStatus readFloat64(void* ppvt,asynUser* pasynUser,
+                              epicsFloat64* value)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  switch( commandTable[which].type )
+    {
+    case CMD_GEN:
+      return genCommandTable[id].readFunc(id, pport, value, Float64, 
+                                          NULL, NULL);
+      break;
+    case CMD_SIMPLE:
+      return readSimpleData( id, pport, value, Float64, NULL, NULL);
+      break;
+    case CMD_CACHE:
+      return readCache(id, pport, value, Float64, NULL, NULL);
+      break;
+    }
+
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private interface asynInt32 methods
+ ****************************************************************************/
+static asynStatus writeInt32(void *ppvt, asynUser *pasynUser, epicsInt32 value)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  switch( commandTable[which].type )
+    {
+    case CMD_GEN:
+      return genCommandTable[id].writeFunc(id, pport, &value, Int32);
+      break;
+    case CMD_SIMPLE:
+      return writeSimpleData( id, pport, (void *) &value, Int32);
+      break;
+    }
+  
+  return asynSuccess;
+}
+
+static asynStatus readInt32(void *ppvt, asynUser *pasynUser, epicsInt32 *value)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  switch( commandTable[which].type )
+    {
+    case CMD_GEN:
+      return genCommandTable[id].readFunc(id, pport, value, Int32, 
+                                          NULL, NULL);
+      break;
+    case CMD_SIMPLE:
+      return readSimpleData( id, pport, value, Int32, NULL, NULL);
+      break;
+    case CMD_CACHE:
+      return readCache(id, pport, value, Int32, NULL, NULL);
+      break;
+    }
+
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private interface asynFloat64Array methods
+ ****************************************************************************/
+static asynStatus writeFloat64Array(void* ppvt,asynUser* pasynUser,
+                                    epicsFloat64* value,size_t nelements)
+{
+  return asynError;
+}
+
+static asynStatus readFloat64Array(void* ppvt,asynUser* pasynUser,
+                                   epicsFloat64* value,size_t nelements,
+                                   size_t* nIn)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  *nIn = nelements;
+  switch( commandTable[which].type )
+    {
+    case CMD_CACHE:
+      return readCache(id, pport, value, Float64Array, nIn, NULL);
+      break;
+    }
+
+  *nIn = 0;
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private interface asynInt32Array methods
+ ****************************************************************************/
+static asynStatus writeInt32Array(void* ppvt,asynUser* pasynUser,
+                                  epicsInt32* value,size_t nelements)
+{
+  return asynError;
+}
+
+static asynStatus readInt32Array(void* ppvt,asynUser* pasynUser,
+                                 epicsInt32* value,size_t nelements,
+                                 size_t* nIn)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  *nIn = nelements;
+  switch( commandTable[which].type )
+    {
+    case CMD_CACHE:
+      return readCache(id, pport, value, Int32Array, nIn, NULL);
+      break;
+    }
+
+  *nIn = 0;
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private interface asynUInt32Digital methods
+ ****************************************************************************/
+static asynStatus writeUInt32Digital(void* ppvt,asynUser* pasynUser,
+                                     epicsUInt32 value,epicsUInt32 mask)
+{
+  return asynError;
+}
+
+static asynStatus readUInt32Digital(void* ppvt,asynUser* pasynUser,
+                                    epicsUInt32* value,epicsUInt32 mask)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+  epicsInt32 ival;
+  asynStatus status;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  switch( commandTable[which].type )
+    {
+    case CMD_CACHE:
+      status = readCache(id, pport, &ival, Int32, NULL, NULL);
+      if( status == asynSuccess)
+        *value = (epicsUInt32) ival & mask;
+      return status;
+      break;
+    }
+
+  return asynError;
+}
+
+
+/****************************************************************************
+ * Define private interface asynOctet methods
+ ****************************************************************************/
+static asynStatus flushOctet(void *ppvt, asynUser* pasynUser)
+{
+  return asynSuccess;
+}
+
+static asynStatus writeOctet(void *ppvt, asynUser *pasynUser, const char *data,
+                             size_t numchars, size_t *nbytes)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  switch( commandTable[which].type )
+    {
+    case CMD_GEN:
+      *nbytes=strlen(data);
+      return genCommandTable[id].writeFunc(id, pport, (void *) data, Octet);
+      break;
+    case CMD_SIMPLE:
+      *nbytes=strlen(data);
+      return writeSimpleData( id, pport, &data, Octet);
+      break;
+    }
+  
+  return asynSuccess;
+}
+
+static asynStatus readOctet(void* ppvt, asynUser* pasynUser, char* data,
+                            size_t maxchars,size_t* nbytes,int* eom)
+{
+  Port* pport=(Port*)ppvt;
+  int which = pasynUser->reason;
+
+  int id;
+  id = commandTable[which].id;
+
+  if( pport->init == 0) 
+    return asynError;
+
+  switch( commandTable[which].type )
+    {
+    case CMD_GEN:
+      return genCommandTable[id].readFunc(id, pport, (void *) data, Octet, 
+                                          nbytes, eom);
+      break;
+    case CMD_SIMPLE:
+      return readSimpleData( id, pport, data, Octet, nbytes, eom);
+      break;
+    case CMD_CACHE:
+      return readCache(id, pport, (void *) data, Octet, nbytes, eom);
+      break;
+    }
+
+  return asynSuccess;
+}
+
+
+/****************************************************************************
+ * Define private Keithley648x external interface asynOctet methods
+ ****************************************************************************/
+static asynStatus writeOnly(Port *pport, const char *outBuf)
+{
+  asynStatus status;
+  size_t nActual, nRequested;
+  epicsTimeStamp start;
+
+  nRequested=strlen(outBuf);
+  epicsTimeGetCurrent( &start);
+  if( pport->replay)
+    {
+      char inpBuf[BUFFER_SIZE];
+      size_t nRead;
+
+      status = replayWriteRead(pport,outBuf,inpBuf,sizeof(inpBuf),&nRead);
+      nActual = nRequested;
+    }
+  else
+    status = 
+      pasynOctetSyncIO->write(pport->pasynUser,outBuf,nRequested,TIMEOUT,
+                              &nActual);
+  if( nActual!=nRequested ) 
+    status = asynError;
+  recordTransaction( pport, outBuf, NULL, nActual, 0, status, &start);
+
+  // the acquisition and ramp threads write too
+  epicsMutexLock( pport->lock);
+  if( status!=asynSuccess )
+    pport->stats.ioErrors++;
+  else
+    pport->stats.writeOnlys++;
+  epicsMutexUnlock( pport->lock);
+
+  if( status!=asynSuccess )
+    asynPrint(pport->pasynUserTrace,ASYN_TRACE_ERROR, 
+              "%s writeOnly: error %d wrote \"%s\"\n",
+              pport->myport,status,outBuf);
+
+  asynPrint(pport->pasynUserTrace, ASYN_TRACEIO_FILTER,
+            "%s writeOnly: wrote \"%s\"\n",
+            pport->myport,outBuf);
+
+  return status;
+}
+
+static asynStatus writeRead(Port *pport, const char *outBuf, char *inpBuf,
+                            int inputSize, int *eomReason)
+{
+  return writeReadTimeout( pport, outBuf, inpBuf, inputSize, eomReason, 
+                           TIMEOUT);
+}
+
+static asynStatus writeReadTimeout(Port *pport, const char *outBuf, 
+                                   char *inpBuf, int inputSize, 
+                                   int *eomReason, double timeout)
+{
+  asynStatus status;
+  size_t nWrite, nRead, nWriteRequested;
+  epicsTimeStamp start;
+
+  nWriteRequested=strlen(outBuf);
+  nRead = 0;
+  epicsTimeGetCurrent( &start);
+  if( pport->replay)
+    {
+      status = replayWriteRead(pport,outBuf,inpBuf,inputSize,&nRead);
+      nWrite = nWriteRequested;
+      *eomReason = 0;
+    }
+  else
+    status = pasynOctetSyncIO->writeRead(pport->pasynUser,outBuf,
+                                         nWriteRequested,inpBuf,inputSize-1,
+                                         timeout,&nWrite,&nRead,eomReason);
+  if( nWrite!=nWriteRequested ) 
+    status = asynError;
+  recordTransaction( pport, outBuf, inpBuf, nWrite, nRead, status, &start);
+
+  epicsMutexLock( pport->lock);
+  if( status!=asynSuccess )
+    pport->stats.ioErrors++;
+  else
+    pport->stats.writeReads++;
+  epicsMutexUnlock( pport->lock);
+
+  if( status!=asynSuccess )
+    asynPrint(pport->pasynUserTrace,ASYN_TRACE_ERROR,
+              "%s writeRead: error %d wrote \"%s\"\n",
+              pport->myport,status,outBuf);
+  else
+    inpBuf[nRead]='\0';
+
+  asynPrint(pport->pasynUserTrace,ASYN_TRACEIO_FILTER,
+            "%s writeRead: wrote \"%s\" read \"%s\"\n",
+            pport->myport,outBuf,inpBuf);
+  
+  return status;
+}
+
+
+/****************************************************************************
+ * Define private I/O flight recorder methods
+ ****************************************************************************/
+
+static void recordTransaction(Port *pport, const char *outBuf, 
+                              const char *inpBuf, size_t nWrite, 
+                              size_t nRead, asynStatus status, 
+                              const epicsTimeStamp *start)
+{
+  Recorder *prec = &pport->recorder;
+  Transaction *ptr;
+  epicsTimeStamp now;
+  size_t n;
+  int dump;
+
+  epicsTimeGetCurrent( &now);
+  epicsMutexLock( prec->lock);
+  ptr = &prec->entry[prec->count++ & (RECORDER_SIZE - 1)];
+  ptr->start = *start;
+  ptr->duration = epicsTimeDiffInSeconds( &now, start);
+  ptr->status = status;
+  ptr->nWrite = nWrite;
+  ptr->nRead = nRead;
+  n = strlen( outBuf);
+  if( n > RECORDER_COMMAND - 1)
+    n = RECORDER_COMMAND - 1;
+  memcpy( ptr->command, outBuf, n);
+  ptr->command[n] = '\0';
+  n = (inpBuf) ? nRead : 0;
+  if( n > RECORDER_RESPONSE - 1)
+    n = RECORDER_RESPONSE - 1;
+  if( n)
+    memcpy( ptr->response, inpBuf, n);
+  ptr->response[n] = '\0';
+
+  dump = (status != asynSuccess) && prec->autoDump && prec->armed;
+  prec->armed = (status == asynSuccess);
+  if( dump)
+    prec->dumps++;
+  epicsMutexUnlock( prec->lock);
+
+  if( dump)
+    recorderDump( pport, 0);
+}
+
+
+/* Replace control characters so raw bytes print on one line */
+static void printable(char *str)
+{
+  for( ; *str; str++)
+    if( ((unsigned char) *str < ' ') || ((unsigned char) *str > '~') )
+      *str = '.';
+}
+
+
+/* Print the last count transactions (0 = all) oldest first */
+static void recorderDump(Port *pport, int count)
+{
+  Recorder *prec = &pport->recorder;
+  Transaction *copy, *ptr;
+  unsigned int total, first, i;
+  char stamp[40];
+
+  // copy out so the I/O paths are not held up by printing
+  copy = (Transaction *) mallocMustSucceed( sizeof(prec->entry), 
+                                            "drvAsynKeithley6485");
+  epicsMutexLock( prec->lock);
+  memcpy( copy, prec->entry, sizeof(prec->entry));
+  total = prec->count;
+  epicsMutexUnlock( prec->lock);
+
+  first = (total > RECORDER_SIZE) ? total - RECORDER_SIZE : 0;
+  if( (count > 0) && (total - first > (unsigned int) count) )
+    first = total - count;
+
+  errlogPrintf("%s %s: last %u of %u transactions\n", driver, pport->myport,
+               total - first, total);
+  for( i = first; i != total; i++)
+    {
+      ptr = &copy[i & (RECORDER_SIZE - 1)];
+      epicsTimeToStrftime( stamp, sizeof(stamp), "%Y/%m/%d %H:%M:%S.%06f",
+                           &ptr->start);
+      printable( ptr->command);
+      printable( ptr->response);
+      errlogPrintf("  %s %8.4f s status %d wrote %d \"%s\" read %d \"%s\"\n",
+                   stamp, ptr->duration, ptr->status, ptr->nWrite, 
+                   ptr->command, ptr->nRead, ptr->response);
+    }
+
+  free( copy);
+}
+
+
+
+
+/****************************************************************************
+ * Define private acquisition and publishing methods
+ ****************************************************************************/
+
+static int parseReading(char *inpBuf, Reading *prd)
+{
+  char *str, *token[3], *saveptr;
+  int pass;
+
+  str = inpBuf;
+  for( pass = 0; pass < 3; pass++, str = NULL)
+    {
+      token[pass] = epicsStrtok_r(str, ",", &saveptr);
+      if (token[pass] == NULL)
+        break;
+    }
+  if( (pass != 1) && (pass != 3) )
+    return -1;
+
+  epicsTimeGetCurrent( &prd->time);
+  prd->burst = 0;
+  prd->reading = atof( token[0]);
+  if( pass == 1)
+    {
+      // FORM:ELEM READ, stand in host seconds for the instrument timestamp
+      prd->timestamp = prd->time.secPastEpoch + prd->time.nsec * 1e-9;
+      // no status element, the overflow shows only in the value
+      prd->status = (fabs( prd->reading) >= OVERFLOW_READING) ? 0x1 : 0;
+    }
+  else
+    {
+      prd->timestamp = atof( token[1]);
+      prd->status = (int) atof( token[2]);
+    }
+
+  return 0;
+}
+
+
+/* Parse the reply to READ? with TRIG:COUN count into prd, return how many 
+   readings it held or -1; a burst reply holding a single reading is taken */
+static int parseReadings(Port *pport, char *inpBuf, Reading *prd, int count)
+{
+  char *str, *token, *saveptr;
+  epicsTimeStamp now;
+  double spacing;
+  int readingOnly, field, n, i;
+
+  if( count <= 1)
+    return parseReading( inpBuf, prd) ? -1 : 1;
+
+  // three elements per reading unless FORM:ELEM READ
+  epicsMutexLock( pport->lock);
+  readingOnly = pport->settings.readingOnly;
+  spacing = 1.0 / expectedRate( &pport->settings);
+  epicsMutexUnlock( pport->lock);
+
+  n = 0;
+  field = 0;
+  for( str = inpBuf; (token = epicsStrtok_r( str, ",", &saveptr)) != NULL; 
+       str = NULL)
+    {
+      if( (field == 0) && (n == BURST_MAX) )
+        return -1;
+      if( field == 0)
+        prd[n].reading = atof( token);
+      else if( field == 1)
+        prd[n].timestamp = atof( token);
+      else
+        prd[n].status = (int) atof( token);
+      if( readingOnly || (++field == 3) )
+        {
+          field = 0;
+          n++;
+        }
+    }
+  if( (n == 0) || (field != 0) )
+    return -1;
+
+  // the last reading was taken just before the reply, the others before it
+  epicsTimeGetCurrent( &now);
+  for( i = 0; i < n; i++)
+    {
+      prd[i].time = now;
+      epicsTimeAddSeconds( &prd[i].time, -(n - 1 - i) * spacing);
+      if( readingOnly)
+        {
+          prd[i].timestamp = prd[i].time.secPastEpoch + 
+            prd[i].time.nsec * 1e-9;
+          prd[i].status = (fabs( prd[i].reading) >= OVERFLOW_READING) ? 
+            0x1 : 0;
+        }
+      prd[i].burst = -1;
+    }
+  prd[n - 1].burst = n;
+
+  return n;
+}
+
+
+/* Note the instrument's trigger count, allocating the burst buffers */
+static void setBurstCount(Port *pport, int count)
+{
+  Burst *pbur = &pport->burst;
+
+  if( (count > 1) && (pbur->buffer == NULL) )
+    {
+      pbur->buffer = (char *) mallocMustSucceed( BURST_BUFFER, 
+                                                 "drvAsynKeithley6485");
+      pbur->readings = (Reading *) callocMustSucceed( BURST_MAX, 
+                                                      sizeof(Reading),
+                                                      "drvAsynKeithley6485");
+    }
+
+  epicsMutexLock( pport->lock);
+  pbur->count = count;
+  epicsMutexUnlock( pport->lock);
+}
+
+
+static int burstCount(Port *pport)
+{
+  int count;
+
+  epicsMutexLock( pport->lock);
+  count = pport->burst.count;
+  epicsMutexUnlock( pport->lock);
+
+  return count;
+}
+
+
+/* Producer side, called from the acquisition thread only */
+static int ringPut(Ring *pring, const Reading *prd)
+{
+  unsigned int head = pring->head;
+
+  if( head - pring->tail == RING_SIZE)
+    {
+      pring->overruns++;
+      return -1;
+    }
+  pring->slot[head & (RING_SIZE - 1)] = *prd;
+  MEMORY_BARRIER();  // slot contents visible before the new head
+  pring->head = head + 1;
+
+  return 0;
+}
+
+
+/* Consumer side, called from the publishing thread only */
+static int ringGet(Ring *pring, Reading *batch, int max)
+{
+  unsigned int tail = pring->tail;
+  unsigned int count;
+  int i;
+
+  count = pring->head - tail;
+  MEMORY_BARRIER();  // head read before the slots it covers
+  if( count > (unsigned int) max)
+    count = max;
+  for( i = 0; i < (int) count; i++)
+    batch[i] = pring->slot[(tail + i) & (RING_SIZE - 1)];
+  MEMORY_BARRIER();  // slots copied before they are handed back
+  pring->tail = tail + count;
+
+  return count;
+}
+
+
+/* Fold one reading into the cache; called for every reading taken */
+static void processReading(Port *pport, const Reading *prd)
+{
+  epicsMutexLock( pport->lock);
+  pport->data.timestamp = (int) prd->timestamp;
+  pport->data.status.raw = prd->status;
+
+  pport->history.value[pport->history.count % HISTORY_SIZE] = prd->reading;
+  pport->history.time[pport->history.count % HISTORY_SIZE] = prd->timestamp;
+  pport->history.count++;
+
+  // READ follows single readings and the mean of each burst
+  if( prd->burst == 0)
+    pport->data.reading = prd->reading;
+  else if( prd->burst > 0)
+    {
+      finishBurst( pport, prd->burst);
+      pport->data.reading = pport->burst.mean;
+    }
+
+  if( pport->charge.running)
+    integrateCharge( &pport->charge, prd);
+  updateCadence( &pport->cadence, prd);
+  filterReading( &pport->filter, prd);
+  if( !(prd->status & 0x1) )
+    histogramReading( &pport->histogram, prd->reading);
+
+  if( (pport->response.responsivity > 0.0) && !(prd->status & 0x1) )
+    {
+      pport->response.power = prd->reading / pport->response.responsivity;
+      pport->response.flux = pport->response.power / 
+        (pport->response.energy * ELECTRON_VOLT);
+    }
+  epicsMutexUnlock( pport->lock);
+}
+
+
+/* Welch spectrum of the history snapshot since the instrument timestamps
+   last went backwards; called with the port locked */
+static void updateSpectrum(Port *pport, size_t count)
+{
+  Spectrum *pspc = &pport->spectrum;
+  History *phist = &pport->history;
+  size_t first, half, k, peak;
+  double dt;
+
+  if( (pspc->segment == 0) || (count == 0) )
+    return;
+
+  for( first = count - 1; first > 0; first--)
+    if( phist->snapTime[first - 1] > phist->snapTime[first])
+      break;
+
+  dt = k648xResample( phist->snapValue + first, phist->snapTime + first, 
+                      count - first, pspc->uniform);
+  pspc->segments = k648xWelch( pspc->uniform, count - first, dt, 
+                               pspc->segment, pspc->psd, pspc->work);
+  if( pspc->segments == 0)
+    return;
+
+  half = pspc->segment / 2;
+  peak = 1;
+  for( k = 0; k <= half; k++)
+    {
+      pspc->freq[k] = k / (pspc->segment * dt);
+      if( (k > 1) && (pspc->psd[k] > pspc->psd[peak]) )
+        peak = k;
+    }
+  pspc->length = half + 1;
+  pspc->peak = pspc->freq[peak];
+}
+
+
+/* Center the bins on center and fill in their axis */
+static void placeHistogram(Histogram *phst, double center)
+{
+  int i;
+
+  phst->center = center;
+  for( i = 0; i < phst->bins; i++)
+    phst->axis[i] = center + (i - phst->bins / 2 + 0.5) * phst->binWidth;
+}
+
+
+static void resetHistogram(Histogram *phst)
+{
+  phst->placed = 0;
+  phst->count = 0;
+  phst->mean = 0.0;
+  phst->m2 = 0.0;
+  phst->outside = 0;
+  memset( phst->counts, 0, sizeof(phst->counts));
+}
+
+
+static void binReading(Histogram *phst, double reading)
+{
+  double x;
+
+  x = floor( (reading - phst->center) / phst->binWidth) + phst->bins / 2;
+  if( !((x >= 0.0) && (x < phst->bins)) )
+    phst->outside++;
+  else
+    phst->counts[(int) x]++;
+}
+
+
+/* Count one reading into the histogram; called with the port locked */
+static void histogramReading(Histogram *phst, double reading)
+{
+  double delta, width, shift;
+  int n, i;
+
+  if( phst->bins == 0)
+    return;
+
+  // exact mean and spread over the warm-up, then a slow running mean
+  phst->count++;
+  if( phst->count <= HISTOGRAM_WARMUP)
+    {
+      delta = reading - phst->mean;
+      phst->mean += delta / phst->count;
+      phst->m2 += delta * (reading - phst->mean);
+    }
+  else
+    phst->mean += HISTOGRAM_WEIGHT * (reading - phst->mean);
+
+  if( !phst->placed)
+    {
+      if( phst->count < HISTOGRAM_WARMUP)
+        {
+          phst->warmup[phst->count - 1] = reading;
+          return;
+        }
+      width = phst->width;
+      if( width <= 0.0)
+        {
+          width = HISTOGRAM_SPAN * sqrt( phst->m2 / (phst->count - 1)) / 
+            phst->bins;
+          // no finer than the readings, which may never have changed
+          if( width < readingCount( phst->mean))
+            width = readingCount( phst->mean);
+        }
+      phst->binWidth = width;
+      placeHistogram( phst, phst->mean);
+      phst->placed = 1;
+      for( i = 0; i < (int) phst->count - 1; i++)
+        binReading( phst, phst->warmup[i]);
+    }
+
+  // follow a drifting mean by whole bins, what falls off is outside; the
+  // shift stays a double until it is known to fit, as a step of the
+  // input can move the mean by 1e9 bins
+  shift = floor( (phst->mean - phst->center) / phst->binWidth + 0.5);
+  if( 4.0 * fabs( shift) > phst->bins)
+    {
+      if( fabs( shift) >= phst->bins)
+        {
+          for( i = 0; i < phst->bins; i++)
+            phst->outside += phst->counts[i];
+          memset( phst->counts, 0, sizeof(phst->counts));
+          placeHistogram( phst, phst->mean);
+        }
+      else if( shift > 0.0)
+        {
+          n = (int) shift;
+          for( i = 0; i < n; i++)
+            phst->outside += phst->counts[i];
+          memmove( phst->counts, phst->counts + n, 
+                   (phst->bins - n) * sizeof(epicsInt32));
+          memset( phst->counts + phst->bins - n, 0, n * sizeof(epicsInt32));
+          placeHistogram( phst, phst->center + n * phst->binWidth);
+        }
+      else
+        {
+          n = (int) -shift;
+          for( i = phst->bins - n; i < phst->bins; i++)
+            phst->outside += phst->counts[i];
+          memmove( phst->counts + n, phst->counts, 
+                   (phst->bins - n) * sizeof(epicsInt32));
+          memset( phst->counts, 0, n * sizeof(epicsInt32));
+          placeHistogram( phst, phst->center - n * phst->binWidth);
+        }
+    }
+
+  binReading( phst, reading);
+}
+
+
+/* Take the burst of the last n readings from the history; called with the
+   port locked */
+static void finishBurst(Port *pport, int n)
+{
+  Burst *pbur = &pport->burst;
+  History *phist = &pport->history;
+  unsigned int first;
+  double sum = 0.0, sumsq = 0.0;
+  int i;
+
+  // a history reset inside the burst leaves fewer
+  if( (unsigned int) n > phist->count)
+    n = phist->count;
+  if( n == 0)
+    return;
+
+  first = phist->count - n;
+  for( i = 0; i < n; i++)
+    {
+      pbur->value[i] = phist->value[(first + i) % HISTORY_SIZE];
+      pbur->time[i] = phist->time[(first + i) % HISTORY_SIZE];
+      sum += pbur->value[i];
+    }
+  pbur->mean = sum / n;
+  for( i = 0; i < n; i++)
+    sumsq += (pbur->value[i] - pbur->mean) * (pbur->value[i] - pbur->mean);
+  pbur->sigma = (n > 1) ? sqrt( sumsq / (n - 1)) : 0.0;
+  pbur->length = n;
+  pbur->fresh = 1;
+}
+
+
+/* Follow the reading interval; called with the port locked */
+static void updateCadence(Cadence *pcad, const Reading *prd)
+{
+  double dt, host, w, d;
+
+  if( pcad->valid)
+    {
+      dt = prd->timestamp - pcad->lastStamp;
+      host = epicsTimeDiffInSeconds( &prd->time, &pcad->lastTime);
+      // a timestamp going backwards (instrument reset) restarts the interval
+      if( dt > 0.0)
+        {
+          if( (pcad->intervals > 0) && (dt > CADENCE_GAP * pcad->mean) )
+            pcad->missed += (int) floor( dt / pcad->mean + 0.5) - 1;
+          if( dt > pcad->maxGap)
+            pcad->maxGap = dt;
+
+          // plain average until the smoothing window is full
+          pcad->intervals++;
+          w = 1.0 / pcad->intervals;
+          if( w < CADENCE_WEIGHT)
+            w = CADENCE_WEIGHT;
+          d = dt - pcad->mean;
+          pcad->mean += w * d;
+          pcad->variance = (1.0 - w) * (pcad->variance + w * d * d);
+          d = host - pcad->arrivalMean;
+          pcad->arrivalMean += w * d;
+          pcad->arrivalVariance = (1.0 - w) * 
+            (pcad->arrivalVariance + w * d * d);
+        }
+    }
+
+  pcad->valid = 1;
+  pcad->lastStamp = prd->timestamp;
+  pcad->lastTime = prd->time;
+}
+
+
+/* Add the interval ending at this reading to the charge, trapezoidal */
+static void integrateCharge(Charge *pchg, const Reading *prd)
+{
+  double dt;
+  int valid;
+
+  // an overflowed reading holds no current, nothing on either side counts
+  valid = !(prd->status & 0x1);
+  if( pchg->valid)
+    {
+      dt = prd->timestamp - pchg->lastTime;
+      if( valid && (dt > 0.0) && ((pchg->maxGap <= 0.0) || 
+                                  (dt <= pchg->maxGap)) )
+        pchg->total += 0.5 * (pchg->lastReading + prd->reading) * dt;
+      else
+        pchg->gaps++;
+    }
+
+  pchg->valid = valid;
+  pchg->lastReading = prd->reading;
+  pchg->lastTime = prd->timestamp;
+}
+
+
+/* Restart the filter chain, keeping its configuration */
+static void resetFilter(Filter *pflt)
+{
+  pflt->valid = 0;
+  pflt->count = 0;
+  pflt->mean = 0.0;
+  pflt->variance = 0.0;
+  pflt->run = 0;
+  pflt->rejected = 0;
+  pflt->medianCount = pflt->medianNext = 0;
+  pflt->averageCount = pflt->averageNext = 0;
+  pflt->averageSum = 0.0;
+  pflt->outlierOut = pflt->medianOut = 0.0;
+  pflt->averageOut = pflt->expOut = 0.0;
+}
+
+
+/* One count of a 5 1/2 digit reading of x on the lowest of the 2 nA to
+   20 mA ranges that holds it */
+static double readingCount(double x)
+{
+  double range;
+
+  for( range = 2e-9; (range < fabs( x)) && (range < 2e-2); range *= 10.0)
+    ;
+
+  return range / 200000.0;
+}
+
+
+/* Run a reading through the filter chain; called with the port locked */
+static void filterReading(Filter *pflt, const Reading *prd)
+{
+  double sorted[FILTER_WINDOW];
+  double x, w, d, dt, sigma;
+  int i, j, n;
+
+  if( prd->status & 0x1)
+    return;
+  x = prd->reading;
+
+  // outlier rejection against the smoothed mean and sigma, which a
+  // constant input would otherwise shrink to nothing
+  sigma = sqrt( pflt->variance);
+  if( sigma < FILTER_COUNTS * readingCount( pflt->mean))
+    sigma = FILTER_COUNTS * readingCount( pflt->mean);
+  if( (pflt->outlierSigma > 0.0) && (pflt->count >= FILTER_WARMUP) &&
+      (fabs( x - pflt->mean) > pflt->outlierSigma * sigma) &&
+      (++pflt->run < FILTER_STEP) )
+    {
+      pflt->rejected++;
+      x = pflt->outlierOut;
+    }
+  else
+    {
+      // a step restarts the statistics from the new level
+      if( pflt->run >= FILTER_STEP)
+        pflt->count = 0;
+      pflt->run = 0;
+      pflt->count++;
+      w = 1.0 / pflt->count;
+      if( w < FILTER_WEIGHT)
+        w = FILTER_WEIGHT;
+      d = x - pflt->mean;
+      pflt->mean += w * d;
+      pflt->variance = (1.0 - w) * (pflt->variance + w * d * d);
+    }
+  pflt->outlierOut = x;
+
+  // median of the window, a small insertion sort
+  if( pflt->medianWindow > 1)
+    {
+      pflt->median[pflt->medianNext] = x;
+      pflt->medianNext = (pflt->medianNext + 1) % pflt->medianWindow;
+      if( pflt->medianCount < pflt->medianWindow)
+        pflt->medianCount++;
+      n = pflt->medianCount;
+      for( i = 0; i < n; i++)
+        {
+          for( j = i; (j > 0) && (sorted[j - 1] > pflt->median[i]); j--)
+            sorted[j] = sorted[j - 1];
+          sorted[j] = pflt->median[i];
+        }
+      x = (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+    }
+  pflt->medianOut = x;
+
+  // moving average, the running sum is redone each time round the window
+  if( pflt->averageWindow > 1)
+    {
+      if( pflt->averageCount == pflt->averageWindow)
+        pflt->averageSum -= pflt->average[pflt->averageNext];
+      else
+        pflt->averageCount++;
+      pflt->average[pflt->averageNext] = x;
+      pflt->averageSum += x;
+      pflt->averageNext = (pflt->averageNext + 1) % pflt->averageWindow;
+      if( pflt->averageNext == 0)
+        for( pflt->averageSum = 0.0, i = 0; i < pflt->averageCount; i++)
+          pflt->averageSum += pflt->average[i];
+      x = pflt->averageSum / pflt->averageCount;
+    }
+  pflt->averageOut = x;
+
+  // exponential over instrument time, so gaps weigh what they lasted
+  dt = prd->timestamp - pflt->lastTime;
+  if( (pflt->expTime > 0.0) && pflt->valid && (dt > 0.0) )
+    x = pflt->expOut + (1.0 - exp( -dt / pflt->expTime)) * (x - pflt->expOut);
+  pflt->expOut = x;
+  pflt->lastTime = prd->timestamp;
+  pflt->valid = 1;
+}
+
+
+/* Responsivity at energy, linear between table points, 0 outside */
+static double interpolateResponse(const ResponseTable *ptab, double energy)
+{
+  int lo, hi, mid;
+  double f;
+
+  if( (ptab == NULL) || (ptab->count < 2) || 
+      (energy < ptab->energy[0]) || (energy > ptab->energy[ptab->count - 1]))
+    return 0.0;
+
+  lo = 0;
+  hi = ptab->count - 1;
+  while( hi - lo > 1)
+    {
+      mid = (lo + hi) / 2;
+      if( ptab->energy[mid] <= energy)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  f = (energy - ptab->energy[lo]) / (ptab->energy[hi] - ptab->energy[lo]);
+
+  return ptab->response[lo] + f * (ptab->response[hi] - ptab->response[lo]);
+}
+
+
+/* Copy the history oldest first into value and/or time, return the length */
+static size_t historySnapshot(Port *pport, double *value, double *time, 
+                              size_t max)
+{
+  History *phist = &pport->history;
+  unsigned int first, n, i;
+
+  epicsMutexLock( pport->lock);
+  n = (phist->count < HISTORY_SIZE) ? phist->count : HISTORY_SIZE;
+  if( n > max)
+    n = max;
+  first = phist->count - n;
+  for( i = 0; i < n; i++)
+    {
+      if( value)
+        value[i] = phist->value[(first + i) % HISTORY_SIZE];
+      if( time)
+        time[i] = phist->time[(first + i) % HISTORY_SIZE];
+    }
+  epicsMutexUnlock( pport->lock);
+
+  return n;
+}
+
+
+/* Call back I/O Intr clients of READ and of the cached scalar and history
+   tags */
+static void publishReadings(Port *pport)
+{
+  ELLLIST *pclientList;
+  interruptNode *pnode;
+  Command *pcmd;
+  epicsFloat64 fval;
+  epicsTimeStamp now;
+  size_t count = 0;
+  unsigned int generation;
+  int due;
+
+  // history waveforms are rate limited, they are large
+  epicsTimeGetCurrent( &now);
+  due = ( epicsTimeDiffInSeconds( &now, &pport->history.last) >= 
+          pport->history.period);
+  if( due)
+    {
+      pport->history.last = now;
+
+      // held until the snapshot has been published
+      epicsMutexLock( pport->lock);
+      count = historySnapshot( pport, pport->history.snapValue, 
+                               pport->history.snapTime, HISTORY_SIZE);
+      k648xReduce( pport->history.snapValue, count, &pport->history.stats);
+      updateSpectrum( pport, count);
+    }
+
+  epicsMutexLock( pport->lock);
+  generation = ++pport->generation;
+  epicsMutexUnlock( pport->lock);
+  pasynManager->interruptStart( pport->asynStdInterfaces.float64InterruptPvt, 
+                                &pclientList);
+  pnode = (interruptNode *)ellFirst(pclientList);
+  while( pnode)
+    {
+      asynFloat64Interrupt *pInterrupt = (asynFloat64Interrupt *)pnode->drvPvt;
+      pcmd = &commandTable[pInterrupt->pasynUser->reason];
+      if( (pcmd->type == CMD_GEN) && (pcmd->id == READ_CMD) )
+        {
+          epicsMutexLock( pport->lock);
+          fval = pport->data.reading;
+          epicsMutexUnlock( pport->lock);
+          if( deadbandPass( pport, pInterrupt->pasynUser->reason, fval, 
+                            generation) )
+            pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, 
+                                  fval);
+        }
+      pnode = (interruptNode *)ellNext(&pnode->node);
+    }
+  pasynManager->interruptEnd( pport->asynStdInterfaces.float64InterruptPvt);
+
+  publishFloat64Cache( pport);
+  publishInt32Cache( pport);
+  publishStatus( pport);
+
+  epicsMutexLock( pport->lock);
+  if( pport->burst.fresh)
+    {
+      pport->burst.fresh = 0;
+      publishArray( pport, BURST_VALUE_CMD, pport->burst.value, 
+                    pport->burst.length);
+      publishArray( pport, BURST_TIME_CMD, pport->burst.time, 
+                    pport->burst.length);
+    }
+  epicsMutexUnlock( pport->lock);
+
+  if( !due)
+    return;
+
+  publishArray( pport, HISTORY_VALUE_CMD, pport->history.snapValue, count);
+  publishArray( pport, HISTORY_TIME_CMD, pport->history.snapTime, count);
+  if( pport->spectrum.segments)
+    {
+      publishArray( pport, PSD_CMD, pport->spectrum.psd, 
+                    pport->spectrum.length);
+      publishArray( pport, PSD_FREQUENCY_CMD, pport->spectrum.freq, 
+                    pport->spectrum.length);
+    }
+  if( pport->histogram.placed)
+    {
+      publishInt32Array( pport, HISTOGRAM_CMD, pport->histogram.counts, 
+                         pport->histogram.bins);
+      publishArray( pport, HISTOGRAM_AXIS_CMD, pport->histogram.axis, 
+                    pport->histogram.bins);
+    }
+  epicsMutexUnlock( pport->lock);
+}
+
+
+/* Call back I/O Intr clients of the cached Float64 tags */
+static void publishFloat64Cache(Port *pport)
+{
+  ELLLIST *pclientList;
+  interruptNode *pnode;
+  Command *pcmd;
+  epicsFloat64 fval;
+  unsigned int generation;
+
+  epicsMutexLock( pport->lock);
+  generation = ++pport->generation;
+  epicsMutexUnlock( pport->lock);
+  pasynManager->interruptStart( pport->asynStdInterfaces.float64InterruptPvt, 
+                                &pclientList);
+  pnode = (interruptNode *)ellFirst(pclientList);
+  while( pnode)
+    {
+      asynFloat64Interrupt *pInterrupt = (asynFloat64Interrupt *)pnode->drvPvt;
+      pcmd = &commandTable[pInterrupt->pasynUser->reason];
+      if( pcmd->type == CMD_CACHE)
+        {
+          if( (readCache( pcmd->id, pport, &fval, Float64, NULL, NULL) == 
+               asynSuccess) &&
+              deadbandPass( pport, pInterrupt->pasynUser->reason, fval, 
+                            generation) )
+            pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, 
+                                  fval);
+        }
+      pnode = (interruptNode *)ellNext(&pnode->node);
+    }
+  pasynManager->interruptEnd( pport->asynStdInterfaces.float64InterruptPvt);
+}
+
+
+/* Call back I/O Intr clients of the cached Int32 tags */
+static void publishInt32Cache(Port *pport)
+{
+  ELLLIST *pclientList;
+  interruptNode *pnode;
+  Command *pcmd;
+  epicsInt32 ival;
+
+  pasynManager->interruptStart( pport->asynStdInterfaces.int32InterruptPvt, 
+                                &pclientList);
+  pnode = (interruptNode *)ellFirst(pclientList);
+  while( pnode)
+    {
+      asynInt32Interrupt *pInterrupt = (asynInt32Interrupt *)pnode->drvPvt;
+      pcmd = &commandTable[pInterrupt->pasynUser->reason];
+      if( pcmd->type == CMD_CACHE)
+        {
+          if( readCache( pcmd->id, pport, &ival, Int32, NULL, NULL) == 
+              asynSuccess)
+            pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, 
+                                  ival);
+        }
+      pnode = (interruptNode *)ellNext(&pnode->node);
+    }
+  pasynManager->interruptEnd( pport->asynStdInterfaces.int32InterruptPvt);
+}
+
+
+/* Decide once per publish pass whether tag reason sends value */
+static int deadbandPass(Port *pport, int reason, double value, 
+                        unsigned int generation)
+{
+  Deadband *pdb = &pport->deadband[reason];
+  epicsTimeStamp now;
+  double change;
+  int pass;
+
+  if( !pdb->active)
+    return 1;
+
+  epicsMutexLock( pport->lock);
+  if( pdb->generation == generation)
+    {
+      // another client of the same tag in this pass
+      pass = pdb->decision;
+      epicsMutexUnlock( pport->lock);
+      return pass;
+    }
+
+  epicsTimeGetCurrent( &now);
+  pass = 1;
+  if( pdb->sent)
+    {
+      change = fabs( value - pdb->last);
+      if( (pdb->absolute > 0.0) || (pdb->relative > 0.0) )
+        pass = ( (pdb->absolute > 0.0) && (change > pdb->absolute) ) ||
+          ( (pdb->relative > 0.0) && (change > pdb->relative * fabs(pdb->last)) );
+      if( pass && (epicsTimeDiffInSeconds( &now, &pdb->lastTime) < 
+                   pdb->minInterval) )
+        pass = 0;
+    }
+
+  if( pass)
+    {
+      pdb->sent = 1;
+      pdb->last = value;
+      pdb->lastTime = now;
+    }
+  else
+    pdb->suppressed++;
+  pdb->generation = generation;
+  pdb->decision = pass;
+  epicsMutexUnlock( pport->lock);
+
+  return pass;
+}
+
+
+/* Call back UInt32Digital I/O Intr clients whose status bits changed */
+static void publishStatus(Port *pport)
+{
+  ELLLIST *pclientList;
+  interruptNode *pnode;
+  Command *pcmd;
+  epicsUInt32 status, changed;
+
+  epicsMutexLock( pport->lock);
+  status = pport->data.status.raw;
+  changed = pport->statusValid ? (status ^ pport->statusPublished) : ~0U;
+  pport->statusPublished = status;
+  pport->statusValid = 1;
+  epicsMutexUnlock( pport->lock);
+  if( !changed)
+    return;
+
+  pasynManager->interruptStart(
+    pport->asynStdInterfaces.uInt32DigitalInterruptPvt, &pclientList);
+  pnode = (interruptNode *)ellFirst(pclientList);
+  while( pnode)
+    {
+      asynUInt32DigitalInterrupt *pInterrupt = 
+        (asynUInt32DigitalInterrupt *)pnode->drvPvt;
+      pcmd = &commandTable[pInterrupt->pasynUser->reason];
+      if( (pcmd->type == CMD_CACHE) && (pcmd->id == STATUS_RAW_CMD) &&
+          (pInterrupt->mask & changed) )
+        pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, 
+                              status & pInterrupt->mask);
+      pnode = (interruptNode *)ellNext(&pnode->node);
+    }
+  pasynManager->interruptEnd( 
+    pport->asynStdInterfaces.uInt32DigitalInterruptPvt);
+}
+
+
+/* Call back I/O Intr clients of the cached Float64Array tag which */
+static void publishArray(Port *pport, int which, double *value, size_t count)
+{
+  ELLLIST *pclientList;
+  interruptNode *pnode;
+  Command *pcmd;
+
+  pasynManager->interruptStart(
+    pport->asynStdInterfaces.float64ArrayInterruptPvt, &pclientList);
+  pnode = (interruptNode *)ellFirst(pclientList);
+  while( pnode)
+    {
+      asynFloat64ArrayInterrupt *pInterrupt = 
+        (asynFloat64ArrayInterrupt *)pnode->drvPvt;
+      pcmd = &commandTable[pInterrupt->pasynUser->reason];
+      if( (pcmd->type == CMD_CACHE) && (pcmd->id == which) )
+        pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, 
+                              value, count);
+      pnode = (interruptNode *)ellNext(&pnode->node);
     }
+  pasynManager->interruptEnd( pport->asynStdInterfaces.float64ArrayInterruptPvt);
+}
 
-  return writeOnly( pport, outBuf);
+
+/* Call back I/O Intr clients of the cached Int32Array tag which */
+static void publishInt32Array(Port *pport, int which, epicsInt32 *value, 
+                              size_t count)
+{
+  ELLLIST *pclientList;
+  interruptNode *pnode;
+  Command *pcmd;
+
+  pasynManager->interruptStart(
+    pport->asynStdInterfaces.int32ArrayInterruptPvt, &pclientList);
+  pnode = (interruptNode *)ellFirst(pclientList);
+  while( pnode)
+    {
+      asynInt32ArrayInterrupt *pInterrupt = 
+        (asynInt32ArrayInterrupt *)pnode->drvPvt;
+      pcmd = &commandTable[pInterrupt->pasynUser->reason];
+      if( (pcmd->type == CMD_CACHE) && (pcmd->id == which) )
+        pInterrupt->callback( pInterrupt->userPvt, pInterrupt->pasynUser, 
+                              value, count);
+      pnode = (interruptNode *)ellNext(&pnode->node);
+    }
+  pasynManager->interruptEnd( pport->asynStdInterfaces.int32ArrayInterruptPvt);
 }
 
 
-static asynStatus readRate(int which, Port *pport, void *data, 
-                           Type Iface, size_t *length, int *eom)
+static void acquireTask(void *arg)
 {
+  Port *pport = (Port *) arg;
+  char inpBuf[BUFFER_SIZE], *buffer;
+  Reading rd, *prd;
+  epicsTimeStamp start, now;
   asynStatus status;
-  char inpBuf[BUFFER_SIZE];
+  double period, interval, wait;
+  int eom, count, size, n, i, queued;
 
-  double val;
-  int rate;
-
-  if( Iface != Int32)
-    return asynSuccess;
+  for(;;)
+    {
+      if( !pport->acq.enabled)
+        {
+          epicsEventWait( pport->acq.wake);
+          continue;
+        }
 
-  status = writeRead( pport, ":NPLC?", inpBuf, BUFFER_SIZE, &pport->data.eom);
-  if( status != asynSuccess)
-    return status;
+      // never poll faster than the instrument can produce readings
+      period = readingPeriod( pport);
+      interval = (pport->acq.period > period) ? pport->acq.period : period;
+
+      epicsTimeGetCurrent( &start);
+      epicsMutexLock( pport->acq.ioLock);
+      count = burstCount( pport);
+      buffer = (count > 1) ? pport->burst.buffer : inpBuf;
+      size = (count > 1) ? BURST_BUFFER : BUFFER_SIZE;
+      prd = (count > 1) ? pport->burst.readings : &rd;
+      status = writeReadTimeout( pport, "READ?", buffer, size, &eom, 
+                                 TIMEOUT + period);
+      n = (status == asynSuccess) ? parseReadings( pport, buffer, prd, count)
+        : -1;
+      for( i = 0, queued = 0; i < n; i++)
+        queued += ( ringPut( &pport->ring, &prd[i]) == 0);
+      epicsMutexUnlock( pport->acq.ioLock);
+      if( n < 0)
+        {
+          // back off so a dead link does not spin the thread
+          pport->acq.errors++;
+          epicsEventWaitWithTimeout( pport->acq.wake, TIMEOUT);
+          continue;
+        }
 
-  val = atof( inpBuf);
-  if( val > 1.0)
-    rate = 0; // SLOW
-  else if( val > 0.1)
-    rate = 1; // MEDIUM
-  else
-    rate = 2; // FAST
-  
-  *((epicsInt32*) data) = rate;
+      pport->acq.readings += n;
+      if( queued)
+        epicsEventSignal( pport->acq.ready);
 
-  return asynSuccess;
+      epicsTimeGetCurrent( &now);
+      wait = interval - epicsTimeDiffInSeconds( &now, &start);
+      if( wait > 0.0)
+        epicsEventWaitWithTimeout( pport->acq.wake, wait);
+    }
 }
 
 
-static asynStatus writeRate( int which, Port *pport, void *data, Type Iface)
+/* Publish everything queued in the ring, return the readings published */
+static int drainRing(Port *pport)
 {
-  char outBuf[BUFFER_SIZE];
-  int rate;
-  double val;
-
-  if( Iface != Int32)
-    return asynSuccess;
-
-  rate = *((epicsInt32*) data);
-  if( (rate < 0) || (rate > 2) )
-    return asynError;
+  Reading batch[PUBLISH_BATCH];
+  int i, count, total = 0;
 
-  switch( rate)
+  while( (count = ringGet( &pport->ring, batch, PUBLISH_BATCH)) > 0)
     {
-    case 0:
-      val = 6.0;
-      break;
-    case 1:
-      val = 1.0;
-      break;
-    case 2:
-      val = 0.1;
-      break;
-    default:
-      val = 1.0;
-      break;
+      for( i = 0; i < count; i++)
+        processReading( pport, &batch[i]);
+      publishReadings( pport);
+      pport->ring.batches++;
+      pport->ring.published += count;
+      if( count > pport->ring.maxBatch)
+        pport->ring.maxBatch = count;
+      total += count;
     }
 
-  sprintf( outBuf, ":NPLC %g", val );
-  return writeOnly( pport, outBuf);
+  return total;
 }
 
 
-static asynStatus readVoltageSettings(int which, Port *pport, void *data, Type Iface, 
-                                      size_t *length, int *eom)
+static void publishTask(void *arg)
 {
-  asynStatus status;
-  char inpBuf[BUFFER_SIZE];
+  Port *pport = (Port *) arg;
 
-  double val;
+  for(;;)
+    {
+      epicsEventWait( pport->acq.ready);
+      drainRing( pport);
+    }
+}
 
-  if(( which != VOLTAGE_RANGE_CMD) && ( which != VOLTAGE_CURRENT_LIMIT_CMD))
-    return asynError;
-  if( Iface == Octet)
-    return asynSuccess;
 
-  if( which == VOLTAGE_RANGE_CMD)
-    status = writeRead( pport, "SOUR:VOLT:RANGE?", inpBuf, BUFFER_SIZE, 
-                        &pport->data.eom);
-  else
-    status = writeRead( pport, "SOUR:VOLT:ILIM?", inpBuf, BUFFER_SIZE, 
-                        &pport->data.eom);
-  if( status != asynSuccess)
-    return status;
+/****************************************************************************
+ * Define private shared I/O engine methods
+ ****************************************************************************/
 
-  val = atof( inpBuf);
-  if( val == 0.0)
-    return asynError;
+static asynStatus engineAdd(Port *pport)
+{
+  asynUser *pasynUser;
+  asynInterface *pasynInterface;
 
-  if( Iface == Float64)
+  pasynUser = pasynManager->createAsynUser( engineProcess, engineTimeout);
+  pasynUser->userPvt = pport;
+  if( pasynManager->connectDevice( pasynUser, pport->ioport, pport->ioaddr) )
     {
-      *((epicsFloat64*) data) = val;
+      pasynManager->freeAsynUser( pasynUser);
+      return asynError;
     }
-  else if( Iface == Int32)
+  pasynInterface = pasynManager->findInterface( pasynUser, asynOctetType, 1);
+  if( pasynInterface == NULL)
     {
-      if( which == VOLTAGE_RANGE_CMD)
-        {
-          if( val == 10.0)
-            *((epicsInt32*) data) = 0;
-          else if( val == 50.0)
-            *((epicsInt32*) data) = 1;
-          else if( val == 500.0)
-            *((epicsInt32*) data) = 2;
-        }
-      else
-        {
-          if( val == 2.5e-5)
-            *((epicsInt32*) data) = 0;
-          else if( val == 2.5e-4)
-            *((epicsInt32*) data) = 1;
-          else if( val == 2.5e-3)
-            *((epicsInt32*) data) = 2;
-          else if( val == 2.5e-2)
-            *((epicsInt32*) data) = 3;
-        }
+      pasynManager->disconnect( pasynUser);
+      pasynManager->freeAsynUser( pasynUser);
+      return asynError;
     }
+  pport->acq.pasynUserQueue = pasynUser;
+  pport->acq.pasynOctet = (asynOctet *) pasynInterface->pinterface;
+  pport->acq.octetPvt = pasynInterface->drvPvt;
+
+  epicsMutexLock( engine->lock);
+  engine->ports = (Port **) realloc( engine->ports, 
+                                     (engine->nports + 1) * sizeof(Port *));
+  if( engine->ports == NULL)
+    cantProceed("drvAsynKeithley6485");
+  pport->acq.worker = engine->nports % engine->workers;
+  pport->acq.wake = engine->wake;
+  pport->acq.ready = engine->ready[pport->acq.worker];
+  engine->ports[engine->nports++] = pport;
+  epicsMutexUnlock( engine->lock);
 
   return asynSuccess;
 }
 
 
-static asynStatus writeVoltageSettings( int which, Port *pport, void *data, Type Iface)
+/* Runs in the octet server's thread once the queued request is granted */
+static void engineProcess(asynUser *pasynUser)
 {
-  char outBuf[BUFFER_SIZE];
-  int value;
+  Port *pport = (Port *) pasynUser->userPvt;
+  char inpBuf[BUFFER_SIZE], *buffer;
+  size_t nWrite = 0, nRead = 0;
+  int eom, count, size, n, i, queued;
+  Reading rd, *prd;
+  asynStatus status;
+  epicsTimeStamp start;
 
-  if(( which != VOLTAGE_RANGE_CMD) && ( which != VOLTAGE_CURRENT_LIMIT_CMD))
-    return asynError;
-  if( Iface != Int32)
-    return asynSuccess;
+  // a sweep owns the line, drop this reading rather than hold up the server
+  if( epicsMutexTryLock( pport->acq.ioLock) != epicsMutexLockOK)
+    {
+      engine->skipped++;
+      pport->acq.pending = 0;
+      epicsEventSignal( engine->wake);
+      return;
+    }
+  count = burstCount( pport);
+  buffer = (count > 1) ? pport->burst.buffer : inpBuf;
+  size = (count > 1) ? BURST_BUFFER : BUFFER_SIZE;
+  prd = (count > 1) ? pport->burst.readings : &rd;
+
+  epicsTimeGetCurrent( &start);
+  pport->acq.pasynOctet->flush( pport->acq.octetPvt, pasynUser);
+  status = pport->acq.pasynOctet->write( pport->acq.octetPvt, pasynUser,
+                                         "READ?", 5, &nWrite);
+  if( status == asynSuccess)
+    status = pport->acq.pasynOctet->read( pport->acq.octetPvt, pasynUser, 
+                                          buffer, size - 1, &nRead, &eom);
+  buffer[nRead] = '\0';
+  recordTransaction( pport, "READ?", buffer, nWrite, nRead, status, &start);
+
+  epicsMutexLock( pport->lock);
+  if( status != asynSuccess)
+    pport->stats.ioErrors++;
+  else
+    pport->stats.writeReads++;
+  epicsMutexUnlock( pport->lock);
 
-  value = *((epicsInt32*) data);
-  if( which == VOLTAGE_RANGE_CMD) 
+  if( status != asynSuccess)
+    asynPrint(pport->pasynUserTrace,ASYN_TRACE_ERROR,
+              "%s engine: error %d wrote \"READ?\"\n",
+              pport->myport,status);
+  else
     {
-      if( (value < 0) || (value > 2) )
-        return asynError;
+      asynPrint(pport->pasynUserTrace,ASYN_TRACEIO_FILTER,
+                "%s engine: wrote \"READ?\" read \"%s\"\n",
+                pport->myport,buffer);
+    }
 
-      if( value == 0)
-        value = 10;
-      else if( value == 1)
-        value = 50;
-      else 
-        value = 500;
-   
-      sprintf( outBuf, "SOUR:VOLT:RANGE %d", value );
+  // the burst buffers stay locked until the readings are queued
+  n = (status == asynSuccess) ? parseReadings( pport, buffer, prd, count) : -1;
+  for( i = 0, queued = 0; i < n; i++)
+    queued += ( ringPut( &pport->ring, &prd[i]) == 0);
+  epicsMutexUnlock( pport->acq.ioLock);
+
+  if( n < 0)
+    {
+      // back off so a dead link is not polled flat out
+      pport->acq.errors++;
+      epicsTimeGetCurrent( &pport->acq.due);
+      epicsTimeAddSeconds( &pport->acq.due, TIMEOUT);
     }
   else
     {
-      if( (value < 0) || (value > 3) )
-        return asynError;
-
-      sprintf( outBuf, "SOUR:VOLT:ILIM 2.5e%d", value - 5 );
+      pport->acq.readings += n;
+      if( queued)
+        epicsEventSignal( pport->acq.ready);
     }
 
-  return writeOnly( pport, outBuf);
+  MEMORY_BARRIER();  // due settled before the scheduler may look at it
+  pport->acq.pending = 0;
+  epicsEventSignal( engine->wake);
 }
 
 
-static asynStatus readCommon(int which, Port *pport, void *data, 
-                             Type Iface, size_t *length, int *eom)
+/* The octet server did not grant the request in time */
+static void engineTimeout(asynUser *pasynUser)
 {
-  asynStatus status;
-  char inpBuf[BUFFER_SIZE];
+  Port *pport = (Port *) pasynUser->userPvt;
+
+  pport->acq.errors++;
+  epicsTimeGetCurrent( &pport->acq.due);
+  epicsTimeAddSeconds( &pport->acq.due, TIMEOUT);
+  MEMORY_BARRIER();  // due settled before the scheduler may look at it
+  pport->acq.pending = 0;
+  epicsEventSignal( engine->wake);
+}
 
-  int val = 0;
 
-  if( Iface != Int32)
-    return asynSuccess;
+/* Queue READ? for every port that is due, sleep until the next one is */
+static void engineTask(void *arg)
+{
+  Port *pport;
+  epicsTimeStamp now;
+  double next, wait, period, interval;
+  int i;
 
-  switch(which)
+  for(;;)
     {
-    case DIGITAL_FILTER_CONTROL_CMD:
-      status = writeRead( pport, "AVER:TCON?", inpBuf, BUFFER_SIZE, 
-                          &pport->data.eom);
+      // queueRequest does not block, so the scan can hold off engineAdd
+      epicsMutexLock( engine->lock);
+      epicsTimeGetCurrent( &now);
+      next = ENGINE_IDLE_WAIT;
+      for( i = 0; i < engine->nports; i++)
+        {
+          pport = engine->ports[i];
+          if( !pport->acq.enabled || pport->acq.pending)
+            continue;
+
+          wait = epicsTimeDiffInSeconds( &pport->acq.due, &now);
+          if( wait > 0.0)
+            {
+              if( wait < next)
+                next = wait;
+              continue;
+            }
+
+          // never poll faster than the instrument can produce readings
+          period = readingPeriod( pport);
+          interval = (pport->acq.period > period) ? pport->acq.period : period;
+          pport->acq.due = now;
+          epicsTimeAddSeconds( &pport->acq.due, interval);
+          if( interval < next)
+            next = interval;
+
+          pport->acq.pending = 1;
+          pport->acq.pasynUserQueue->timeout = TIMEOUT + period;
+          if( pasynManager->queueRequest( pport->acq.pasynUserQueue, 
+                                          asynQueuePriorityLow, 
+                                          TIMEOUT + period) )
+            {
+              pport->acq.pending = 0;
+              pport->acq.errors++;
+            }
+          else
+            engine->requests++;
+        }
+      epicsMutexUnlock( engine->lock);
 
-      if( status != asynSuccess)
-        return status;
-      if( !strcmp( "MOV", inpBuf) )
-        val = 0;
-      else if( !strcmp( "REP", inpBuf) )
-        val = 1;
-      else
-        return asynError;
-      break;
+      epicsEventWaitWithTimeout( engine->wake, next);
     }
-  
-  *((epicsInt32*) data) = val;
-
-  return asynSuccess;
 }
 
 
-static asynStatus writeCommon( int which, Port *pport, void *data, Type Iface)
+/* Drain the rings of the ports assigned to one worker */
+static void engineWorker(void *arg)
 {
-  char outBuf[BUFFER_SIZE];
-  int val;
-
-  if( Iface != Int32)
-    return asynSuccess;
+  int worker = (int) (size_t) arg;
+  Port *pport;
+  int i, published;
 
-  val = *((epicsInt32*) data);
-  switch( which)
+  for(;;)
     {
-    case DIGITAL_FILTER_CONTROL_CMD:
-      if( !val)
-        sprintf( outBuf, "AVER:TCON MOV" );
-      else if(val == 1)
-        sprintf( outBuf, "AVER:TCON REP" );
-      else
-        return asynError;
-      break;
+      epicsEventWait( engine->ready[worker]);
+      do
+        {
+          published = 0;
+          for( i = worker; ; i += engine->workers)
+            {
+              epicsMutexLock( engine->lock);
+              pport = (i < engine->nports) ? engine->ports[i] : NULL;
+              epicsMutexUnlock( engine->lock);
+              if( pport == NULL)
+                break;
+              published += drainRing( pport);
+            }
+        }
+      while( published);
     }
-
-  return writeOnly( pport, outBuf);
 }
 
 
 /****************************************************************************
- * Define private interface asynCommon methods
+ * Define private settings cache methods
  ****************************************************************************/
-static void report(void* ppvt,FILE* fp,int details)
+
+/* Read every setting the reading rate depends on in one transaction */
+static asynStatus refreshSettings(Port *pport)
 {
-  //  int i;
-  Port* pport = (Port*)ppvt;
+  char inpBuf[BUFFER_SIZE];
+  char *str, *token[11], *saveptr;
+  Settings set;
+  asynStatus status;
+  int eom, n, count;
 
-  fprintf( fp, "Keithley648x port: %s\n", pport->myport);
-  if( details)
+  status = writeRead( pport, "SYST:LFR?;:NPLC?;:SYST:AZER?;:DISP:ENAB?;"
+                      ":AVER?;:AVER:COUN?;:AVER:TCON?;:MED?;:RANGE:AUTO?;"
+                      ":FORM:ELEM?;:TRIG:COUN?", inpBuf, BUFFER_SIZE, &eom);
+  if( status != asynSuccess)
+    return status;
+
+  // replies come back in order, ';' separated
+  for( n = 0, str = inpBuf; n < 11; n++, str = NULL)
+    if( (token[n] = epicsStrtok_r( str, ";", &saveptr)) == NULL)
+      return asynError;
+
+  set.lineFrequency = atof( token[0]);
+  set.nplc = atof( token[1]);
+  set.autozero = atoi( token[2]);
+  set.display = atoi( token[3]);
+  set.average = atoi( token[4]);
+  set.averageCount = atoi( token[5]);
+  set.averageRepeat = !epicsStrCaseCmp( token[6], "REP");
+  set.median = atoi( token[7]);
+  set.rangeAuto = atoi( token[8]);
+  set.readingOnly = ( strchr( token[9], ',') == NULL);
+  count = atoi( token[10]);
+  if( (set.lineFrequency <= 0.0) || (set.nplc <= 0.0) || 
+      (set.averageCount < 1) || (count < 1) )
+    return asynError;
+
+  // a larger count set elsewhere would overrun the burst buffer, so the
+  // instrument is brought down to BURST_MAX to match the cache
+  if( count > BURST_MAX)
     {
-      fprintf( fp, "    server:     %s\n", pport->ioport);
-      fprintf( fp, "    address:    %d\n", pport->ioaddr);
-      fprintf( fp, "    ioErrors:   %d\n", pport->stats.ioErrors);
-      fprintf( fp, "    writeReads: %d\n", pport->stats.writeReads);
-      fprintf( fp, "    writeOnlys: %d\n", pport->stats.writeOnlys);
-      fprintf( fp, "    support %s initialized\n",(pport->init)?"IS":"IS NOT");
+      sprintf( inpBuf, "TRIG:COUN %d", BURST_MAX);
+      if( writeOnly( pport, inpBuf) != asynSuccess)
+        return asynError;
+      count = BURST_MAX;
     }
+  setBurstCount( pport, count);
 
-}
+  epicsMutexLock( pport->lock);
+  pport->settings = set;
+  epicsMutexUnlock( pport->lock);
+  publishFloat64Cache( pport);
 
-static asynStatus connect(void* ppvt,asynUser* pasynUser)
-{
-  pasynManager->exceptionConnect(pasynUser);
   return asynSuccess;
 }
 
-static asynStatus disconnect(void* ppvt,asynUser* pasynUser)
+
+/* Keep the cache in step with simple commands that change a setting */
+static void noteSimpleSetting(Port *pport, int which, double val)
 {
-  pasynManager->exceptionDisconnect(pasynUser);
-  return asynSuccess;
+  Settings *pset = &pport->settings;
+  double lineFrequency;
+
+  epicsMutexLock( pport->lock);
+  switch( which)
+    {
+    case RESET_CMD:
+      lineFrequency = pset->lineFrequency;
+      *pset = resetSettings;
+      pset->lineFrequency = lineFrequency;
+      pport->burst.count = 1;
+      break;
+    case RANGE_AUTO_CMD:
+      pset->rangeAuto = (val != 0.0);
+      break;
+    case AUTOZERO_CMD:
+      pset->autozero = (val != 0.0);
+      break;
+    case MEDIAN_FILTER_CMD:
+      pset->median = (val != 0.0);
+      break;
+    case DIGITAL_FILTER_CMD:
+      pset->average = (val != 0.0);
+      break;
+    case DIGITAL_FILTER_COUNT_CMD:
+      if( val >= 1.0)
+        pset->averageCount = (int) val;
+      break;
+    default:
+      epicsMutexUnlock( pport->lock);
+      return;
+    }
+  epicsMutexUnlock( pport->lock);
+
+  publishFloat64Cache( pport);
 }
 
 
-/****************************************************************************
- * Define private interface asynDrvUser methods
- ****************************************************************************/
-static asynStatus create(void* ppvt, asynUser *pasynUser, const char *drvInfo, 
-                         const char **pptypeName, size_t *psize)
+/* Return the profile the settings amount to, or PROFILE_CUSTOM */
+static int matchProfile(const Settings *pset)
 {
-  Port* pport=(Port*)ppvt;
-  
+  const Settings *pprof;
   int i;
-  
-  for(i = 0; i < COMMAND_NUMBER; i++) 
-    if( !epicsStrCaseCmp( drvInfo, commandTable[i].tag) ) 
-      {
-        if( (commandTable[i].dev != DEV_ALL) && 
-            (commandTable[i].dev != pport->devtype) )
-          {
-            errlogPrintf("%s::create port %s failed as tag %s is for different "
-                         "device\n", driver, pport->myport, drvInfo);
-            pasynUser->reason = 0;
-            return asynError;
-          }
-        pasynUser->reason = i;
-        break;
-      }
-  if( i == COMMAND_NUMBER ) 
+
+  for( i = 0; i < PROFILE_CUSTOM; i++)
     {
-      errlogPrintf("%s::create port %s failed to find tag %s\n",
-                   driver, pport->myport, drvInfo);
-      pasynUser->reason = 0;
-      return asynError;
+      pprof = &profileTable[i];
+      if( (fabs( pset->nplc - pprof->nplc) < 1e-6) &&
+          (pset->autozero == pprof->autozero) &&
+          (pset->display == pprof->display) &&
+          (pset->average == pprof->average) &&
+          (!pset->average || 
+           ((pset->averageCount == pprof->averageCount) && 
+            (pset->averageRepeat == pprof->averageRepeat))) &&
+          (pset->median == pprof->median) &&
+          (pset->rangeAuto == pprof->rangeAuto) &&
+          (pset->readingOnly == pprof->readingOnly) )
+        return i;
     }
-  
-  return asynSuccess;
+
+  return PROFILE_CUSTOM;
 }
 
-static asynStatus gettype(void* ppvt,asynUser* pasynUser,
-                          const char** pptypeName,size_t* psize)
+
+/* Readings per second the instrument settles at with these settings */
+static double expectedRate(const Settings *pset)
 {
-  if( pptypeName ) 
-    *pptypeName = NULL;
-  if( psize ) 
-    *psize = 0;
-
-  return asynSuccess;
+  double period;
+
+  period = pset->nplc / pset->lineFrequency;
+  if( pset->autozero)
+    period *= 3.0;  // signal, zero and reference conversion per reading
+  period += READING_OVERHEAD;
+  if( pset->display)
+    period += DISPLAY_OVERHEAD;
+  // a repeating filter returns one reading per filled window
+  if( pset->average && pset->averageRepeat)
+    period *= pset->averageCount;
+
+  return 1.0 / period;
 }
 
-static asynStatus destroy(void* ppvt,asynUser* pasynUser)
+
+/* Seconds the instrument is expected to take per READ?, a whole burst */
+static double readingPeriod(Port *pport)
 {
-  return asynSuccess;
+  double period;
+
+  epicsMutexLock( pport->lock);
+  period = pport->burst.count / expectedRate( &pport->settings);
+  epicsMutexUnlock( pport->lock);
+
+  return period;
 }
 
 
 /****************************************************************************
- * Define private interface asynFloat64 methods
+ * Define private replay (virtual instrument) methods
  ****************************************************************************/
-static asynStatus writeFloat64(void* ppvt,asynUser* pasynUser,
-                               epicsFloat64 value)
+
+// Settings a freshly reset instrument reports, so refreshes find sane values
+static const char *replayDefaults[][2] = 
+  {
+    { "*OPC",               "1"            },
+    { "RANGE",              "2.000000E-09" },
+    { "RANGE:AUTO",         "1"            },
+    { "RANGE:AUTO:ULIM",    "2.000000E-02" },
+    { "RANGE:AUTO:LLIM",    "2.000000E-09" },
+    { "NPLC",               "6.000000E+00" },
+    { "SYST:LFR",           "60"           },
+    { "SYST:AZER",          "1"            },
+    { "DISP:ENAB",          "1"            },
+    { "FORM:ELEM",          "READ,TIME,STAT" },
+    { "SYST:ZCH",           "0"            },
+    { "SYST:ZCOR",          "0"            },
+    { "MED",                "0"            },
+    { "MED:RANK",           "1"            },
+    { "AVER",               "0"            },
+    { "AVER:COUN",          "10"           },
+    { "AVER:TCON",          "REP"          },
+    { "TRIG:COUN",          "1"            },
+    { "SOUR:VOLT",          "0.000000E+00" },
+    { "SOUR:VOLT:STAT",     "0"            },
+    { "SOUR:VOLT:RANGE",    "1.000000E+01" },
+    { "SOUR:VOLT:ILIM",     "2.500000E-05" },
+    { "SOUR:VOLT:INT",      "0"            },
+    { "SOUR:VOLT:INT:FAIL", "0"            },
+  };
+
+
+static ReplaySetting *replaySetting(Replay *prep, const char *key, int create)
 {
-  Port* pport=(Port*)ppvt;
-  int which = pasynUser->reason;
+  int i;
 
-  int id;
-  id = commandTable[which].id;
+  for( i = 0; i < prep->nsettings; i++)
+    if( !epicsStrCaseCmp( prep->settings[i].key, key) )
+      return &prep->settings[i];
 
-  if( pport->init == 0) 
-    return asynError;
+  if( !create || (prep->nsettings == REPLAY_SETTINGS) || 
+      (strlen(key) >= sizeof(prep->settings[0].key)) )
+    return NULL;
 
-   switch( commandTable[which].type )
+  strcpy( prep->settings[prep->nsettings].key, key);
+  prep->settings[prep->nsettings].value[0] = '\0';
+  return &prep->settings[prep->nsettings++];
+}
+
+
+static int replayLoadBinary(Replay *prep, FILE *fp)
+{
+  ReplayRecord rec;
+  epicsFloat64 reading, timestamp;
+  epicsInt32 status;
+  int size = 0;
+
+  while( (fread( &reading, sizeof(reading), 1, fp) == 1) &&
+         (fread( &timestamp, sizeof(timestamp), 1, fp) == 1) &&
+         (fread( &status, sizeof(status), 1, fp) == 1) )
     {
-    case CMD_GEN:
-      return genCommandTable[id].writeFunc(id, pport, &value, Float64);
-      break;
-    case CMD_SIMPLE:
-      return writeSimpleData( id, pport, &value, Float64);
-      break;
+      if( prep->count == size)
+        {
+          size = size ? 2 * size : 1024;
+          prep->records = (ReplayRecord *) realloc( prep->records, 
+                                                    size * sizeof(rec));
+          if( prep->records == NULL)
+            return -1;
+        }
+      rec.reading = reading;
+      rec.timestamp = timestamp;
+      rec.status = status;
+      prep->records[prep->count++] = rec;
     }
 
-  return asynSuccess;
+  return 0;
 }
 
-static asynStatus readFloat64(void* ppvt,asynUser* pasynUser,
-                              epicsFloat64* value)
-{
-  Port* pport=(Port*)ppvt;
-  int which = pasynUser->reason;
-
-  int id;
-  id = commandTable[which].id;
 
-  if( pport->init == 0) 
-    return asynError;
+static int replayLoadText(Replay *prep, FILE *fp)
+{
+  ReplayRecord rec;
+  char line[BUFFER_SIZE];
+  char *str, *end;
+  int size = 0;
 
-  switch( commandTable[which].type )
+  while( fgets( line, sizeof(line), fp) )
     {
-    case CMD_GEN:
-      return genCommandTable[id].readFunc(id, pport, value, Float64, 
-                                          NULL, NULL);
-      break;
-    case CMD_SIMPLE:
-      return readSimpleData( id, pport, value, Float64, NULL, NULL);
-      break;
-    case CMD_CACHE:
-      return readCache(id, pport, value, Float64, NULL, NULL);
-      break;
+      str = line + strspn( line, " \t");
+      if( (*str == '#') || (*str == '\r') || (*str == '\n') || !*str)
+        continue;
+
+      // reading may carry a unit suffix exactly as the instrument sends it
+      rec.reading = strtod( str, &end);
+      if( end == str)
+        return -1;
+      str = strchr( end, ',');
+      if( str == NULL)
+        return -1;
+      rec.timestamp = strtod( ++str, &end);
+      if( end == str)
+        return -1;
+      str = strchr( end, ',');
+      if( str == NULL)
+        return -1;
+      rec.status = (int) strtod( ++str, &end);
+      if( end == str)
+        return -1;
+
+      if( prep->count == size)
+        {
+          size = size ? 2 * size : 1024;
+          prep->records = (ReplayRecord *) realloc( prep->records, 
+                                                    size * sizeof(rec));
+          if( prep->records == NULL)
+            return -1;
+        }
+      prep->records[prep->count++] = rec;
     }
 
-  return asynSuccess;
+  return 0;
 }
 
 
-/****************************************************************************
- * Define private interface asynInt32 methods
- ****************************************************************************/
-static asynStatus writeInt32(void *ppvt, asynUser *pasynUser, epicsInt32 value)
+static Replay *replayOpen(const char *path)
 {
-  Port* pport=(Port*)ppvt;
-  int which = pasynUser->reason;
-
-  int id;
-  id = commandTable[which].id;
-
-  if( pport->init == 0) 
-    return asynError;
+  Replay *prep;
+  FILE *fp;
+  size_t len;
+  unsigned int i;
+  int status;
+
+  len = strlen(path);
+  fp = fopen( path, "rb");
+  if( fp == NULL)
+    return NULL;
+
+  prep = (Replay*)callocMustSucceed(1,sizeof(Replay),"drvAsynKeithley6485");
+  prep->path = epicsStrDup(path);
+  prep->speed = 1.0;
+  prep->lock = epicsMutexMustCreate();
+
+  if( (len > 4) && !epicsStrCaseCmp( path + len - 4, ".bin") )
+    status = replayLoadBinary( prep, fp);
+  else
+    status = replayLoadText( prep, fp);
+  fclose(fp);
 
-  switch( commandTable[which].type )
+  if( (status != 0) || (prep->count == 0) )
     {
-    case CMD_GEN:
-      return genCommandTable[id].writeFunc(id, pport, &value, Int32);
-      break;
-    case CMD_SIMPLE:
-      return writeSimpleData( id, pport, (void *) &value, Int32);
-      break;
+      epicsMutexDestroy( prep->lock);
+      free( prep->records);
+      free( prep->path);
+      free( prep);
+      return NULL;
     }
-  
-  return asynSuccess;
+
+  for( i = 0; i < sizeof(replayDefaults) / sizeof(replayDefaults[0]); i++)
+    strcpy( replaySetting( prep, replayDefaults[i][0], 1)->value, 
+            replayDefaults[i][1]);
+
+  epicsTimeGetCurrent( &prep->start);
+
+  return prep;
 }
 
-static asynStatus readInt32(void *ppvt, asynUser *pasynUser, epicsInt32 *value)
+
+/* Answer one command of a line, called with the replay lock held */
+/* Called with prep->lock held; a READ? reply is only due after *pwait
+   seconds, which the caller sleeps once the lock is released */
+static asynStatus replayCommand(Port *pport, const char *cmd, 
+                                char *reply, int replySize, double *pwait)
 {
-  Port* pport=(Port*)ppvt;
-  int which = pasynUser->reason;
+  Replay *prep = pport->replay;
+  ReplayRecord *prec;
+  ReplaySetting *pset;
+  epicsTimeStamp now;
+  char key[BUFFER_SIZE];
+  const char *value;
+  char *end;
+  double wait, number;
+  size_t len;
+
+  reply[0] = '\0';
+
+  if( !epicsStrCaseCmp( cmd, "READ?") )
+    {
+      prec = &prep->records[prep->next];
 
-  int id;
-  id = commandTable[which].id;
+      // hold the reply back until the recorded instrument produced it
+      if( prep->speed > 0.0)
+        {
+          epicsTimeGetCurrent( &now);
+          wait = (prec->timestamp - prep->records[0].timestamp) / 
+            prep->speed - epicsTimeDiffInSeconds( &now, &prep->start);
+          if( wait > *pwait)
+            *pwait = wait;
+        }
 
-  if( pport->init == 0) 
-    return asynError;
+      pset = replaySetting( prep, "FORM:ELEM", 0);
+      if( pset && !epicsStrCaseCmp( pset->value, "READ") )
+        epicsSnprintf( reply, replySize, "%+.6EA", prec->reading);
+      else
+        epicsSnprintf( reply, replySize, "%+.6EA,%+.3f,%+.6E", 
+                       prec->reading, prec->timestamp, (double) prec->status);
 
-  switch( commandTable[which].type )
+      if( ++prep->next == prep->count)
+        {
+          prep->next = 0;
+          prep->passes++;
+          epicsTimeGetCurrent( &prep->start);
+        }
+    }
+  else if( !epicsStrCaseCmp( cmd, "*IDN?") )
     {
-    case CMD_GEN:
-      return genCommandTable[id].readFunc(id, pport, value, Int32, 
-                                          NULL, NULL);
-      break;
-    case CMD_SIMPLE:
-      return readSimpleData( id, pport, value, Int32, NULL, NULL);
-      break;
-    case CMD_CACHE:
-      return readCache(id, pport, value, Int32, NULL, NULL);
-      break;
+      epicsSnprintf( reply, replySize, "KEITHLEY INSTRUMENTS INC.,"
+                     "MODEL %s,REPLAY,A00 Jan  1 2000 00:00:00/A00 /A",
+                     (pport->devtype == DEV_6487) ? "6487" : "6485");
+    }
+  else
+    {
+      // remaining commands are "KEY?" queries or "KEY [VALUE]" settings
+      len = strcspn( cmd, " ?");
+      if( len >= sizeof(key))
+        return asynError;
+      memcpy( key, cmd, len);
+      key[len] = '\0';
+
+      if( cmd[len] == '?')
+        {
+          pset = replaySetting( prep, key, 0);
+          value = pset ? pset->value : "0";
+          epicsSnprintf( reply, replySize, "%s", value);
+        }
+      else if( cmd[len] == ' ')
+        {
+          pset = replaySetting( prep, key, 1);
+          if( pset == NULL)
+            return asynError;
+          value = cmd + len + 1;
+          number = strtod( value, &end);
+          // echo real numbers back the way the instrument formats them
+          if( (end != value) && !*end && strpbrk( value, ".eE") )
+            epicsSnprintf( pset->value, sizeof(pset->value), "%E", number);
+          else
+            {
+              strncpy( pset->value, value, sizeof(pset->value) - 1);
+              pset->value[sizeof(pset->value) - 1] = '\0';
+            }
+        }
     }
 
   return asynSuccess;
 }
 
 
-/****************************************************************************
- * Define private interface asynOctet methods
- ****************************************************************************/
-static asynStatus flushOctet(void *ppvt, asynUser* pasynUser)
+static asynStatus replayWriteRead(Port *pport, const char *outBuf, 
+                                  char *inpBuf, int inputSize, size_t *nRead)
 {
-  return asynSuccess;
-}
+  Replay *prep = pport->replay;
+  char cmd[BUFFER_SIZE];
+  char reply[BUFFER_SIZE];
+  const char *str;
+  size_t len;
+  double wait = 0.0;
+  asynStatus status = asynSuccess;
+
+  *nRead = 0;
+  inpBuf[0] = '\0';
+
+  epicsMutexLock( prep->lock);
+  // a line may carry several ';' separated commands, replies join likewise
+  for( str = outBuf; *str && (status == asynSuccess); str += len)
+    {
+      if( *str == ';')
+        str++;
+      while( *str == ':')
+        str++;
+      len = strcspn( str, ";");
+      if( len >= sizeof(cmd))
+        {
+          status = asynError;
+          break;
+        }
+      memcpy( cmd, str, len);
+      cmd[len] = '\0';
 
-static asynStatus writeOctet(void *ppvt, asynUser *pasynUser, const char *data,
-                             size_t numchars, size_t *nbytes)
-{
-  Port* pport=(Port*)ppvt;
-  int which = pasynUser->reason;
+      status = replayCommand( pport, cmd, reply, sizeof(reply), &wait);
+      if( (status == asynSuccess) && reply[0] && ((int) *nRead < inputSize))
+        *nRead += epicsSnprintf( inpBuf + *nRead, inputSize - *nRead, 
+                                 "%s%s", *nRead ? ";" : "", reply);
+    }
+  epicsMutexUnlock( prep->lock);
 
-  int id;
-  id = commandTable[which].id;
+  // pace READ? without holding up the other queries
+  if( wait > 0.0)
+    epicsThreadSleep( wait);
 
-  if( pport->init == 0) 
-    return asynError;
+  if( (int) *nRead >= inputSize)
+    *nRead = inputSize - 1;
 
-  switch( commandTable[which].type )
-    {
-    case CMD_GEN:
-      *nbytes=strlen(data);
-      return genCommandTable[id].writeFunc(id, pport, (void *) data, Octet);
-      break;
-    case CMD_SIMPLE:
-      *nbytes=strlen(data);
-      return writeSimpleData( id, pport, &data, Octet);
-      break;
-    }
-  
-  return asynSuccess;
+  return status;
 }
 
-static asynStatus readOctet(void* ppvt, asynUser* pasynUser, char* data,
-                            size_t maxchars,size_t* nbytes,int* eom)
-{
-  Port* pport=(Port*)ppvt;
-  int which = pasynUser->reason;
 
-  int id;
-  id = commandTable[which].id;
+/****************************************************************************
+ * Define private serial baud rate methods
+ ****************************************************************************/
 
-  if( pport->init == 0) 
+// Rates the 6485/6487 RS-232 interface supports, fastest first
+static const int baudRates[] = 
+  { 57600, 38400, 19200, 9600, 4800, 2400, 1200, 600, 300 };
+
+
+static asynStatus setBaud(Port *pport, int baud)
+{
+  char val[16];
+
+  sprintf( val, "%d", baud);
+  if( asynSetOption( pport->ioport, pport->ioaddr, "baud", val) )
     return asynError;
 
-  switch( commandTable[which].type )
-    {
-    case CMD_GEN:
-      return genCommandTable[id].readFunc(id, pport, (void *) data, Octet, 
-                                          nbytes, eom);
-      break;
-    case CMD_SIMPLE:
-      return readSimpleData( id, pport, data, Octet, nbytes, eom);
-      break;
-    case CMD_CACHE:
-      return readCache(id, pport, (void *) data, Octet, nbytes, eom);
-      break;
-    }
+  // drop anything received at the old rate
+  pasynOctetSyncIO->flush( pport->pasynUser);
 
   return asynSuccess;
 }
 
 
-/****************************************************************************
- * Define private Keithley648x external interface asynOctet methods
- ****************************************************************************/
-static asynStatus writeOnly(Port *pport, const char *outBuf)
+/* Try every instrument rate until *IDN? is answered */
+static asynStatus findBaud(Port *pport, char *inpBuf, int inputSize)
 {
-  asynStatus status;
-  size_t nActual, nRequested;
-
-  nRequested=strlen(outBuf);
-  status = 
-    pasynOctetSyncIO->write(pport->pasynUser,outBuf,nRequested,TIMEOUT,&nActual);
-  if( nActual!=nRequested ) 
-    status = asynError;
+  unsigned int i;
+  int eom;
 
-  if( status!=asynSuccess )
+  for( i = 0; i < sizeof(baudRates) / sizeof(baudRates[0]); i++)
     {
-      pport->stats.ioErrors++;
-      asynPrint(pport->pasynUserTrace,ASYN_TRACE_ERROR, 
-                "%s writeOnly: error %d wrote \"%s\"\n",
-                pport->myport,status,outBuf);
+      // not a serial port if the option is refused
+      if( setBaud( pport, baudRates[i]) )
+        return asynError;
+      if( writeReadTimeout( pport, "*IDN?", inpBuf, inputSize, &eom, 
+                            PROBE_TIMEOUT) == asynSuccess)
+        {
+          pport->baud = baudRates[i];
+          errlogPrintf("%s::findBaud port %s found instrument at %d baud\n",
+                       driver, pport->myport, pport->baud);
+          return asynSuccess;
+        }
     }
-  else
-    pport->stats.writeOnlys++;
-
-  asynPrint(pport->pasynUserTrace, ASYN_TRACEIO_FILTER,
-            "%s writeOnly: wrote \"%s\"\n",
-            pport->myport,outBuf);
 
-  return status;
+  return asynError;
 }
 
-static asynStatus writeRead(Port *pport, const char *outBuf, char *inpBuf,
-                            int inputSize, int *eomReason)
+
+/* Switch instrument then port to baud, fall back to the old rate */
+static asynStatus negotiateBaud(Port *pport, int baud)
 {
-  asynStatus status;
-  size_t nWrite, nRead, nWriteRequested;
+  char outBuf[BUFFER_SIZE];
+  char inpBuf[BUFFER_SIZE];
+  unsigned int i;
+  int eom;
 
-  nWriteRequested=strlen(outBuf);
-  status = pasynOctetSyncIO->writeRead(pport->pasynUser,outBuf,
-                                       nWriteRequested,inpBuf,inputSize-1,
-                                       TIMEOUT,&nWrite,&nRead,eomReason);
-  if( nWrite!=nWriteRequested ) 
-    status = asynError;
+  for( i = 0; i < sizeof(baudRates) / sizeof(baudRates[0]); i++)
+    if( baudRates[i] == baud)
+      break;
+  if( i == sizeof(baudRates) / sizeof(baudRates[0]) )
+    return asynError;
 
-  if( status!=asynSuccess )
-    {
-      pport->stats.ioErrors++;
-      asynPrint(pport->pasynUserTrace,ASYN_TRACE_ERROR,
-                "%s writeRead: error %d wrote \"%s\"\n",
-                pport->myport,status,outBuf);
-    }
-  else
+  sprintf( outBuf, "SYST:COMM:SER:BAUD %d", baud);
+  if( writeOnly( pport, outBuf) )
+    return asynError;
+
+  // give the instrument time to finish the reply side of the old rate
+  epicsThreadSleep( 0.1);
+  if( (setBaud( pport, baud) == asynSuccess) &&
+      (writeReadTimeout( pport, "*IDN?", inpBuf, sizeof(inpBuf), &eom, 
+                         PROBE_TIMEOUT) == asynSuccess) )
     {
-      inpBuf[nRead]='\0';
-      pport->stats.writeReads++;
+      pport->baud = baud;
+      return asynSuccess;
     }
 
-  asynPrint(pport->pasynUserTrace,ASYN_TRACEIO_FILTER,
-            "%s writeRead: wrote \"%s\" read \"%s\"\n",
-            pport->myport,outBuf,inpBuf);
-  
-  return status;
+  // the instrument may or may not have switched, find it again
+  if( pport->baud)
+    setBaud( pport, pport->baud);
+  if( writeReadTimeout( pport, "*IDN?", inpBuf, sizeof(inpBuf), &eom, 
+                        PROBE_TIMEOUT) != asynSuccess)
+    findBaud( pport, inpBuf, sizeof(inpBuf));
+
+  return asynError;
 }
 
 
@@ -1318,12 +6134,94 @@ static const iocshArg arg0 = {"type",iocshArgString};
 static const iocshArg arg1 = {"myport",iocshArgString};
 static const iocshArg arg2 = {"ioport",iocshArgString};
 static const iocshArg arg3 = {"ioaddr",iocshArgInt};
-static const iocshArg* args[]= {&arg0,&arg1,&arg2,&arg3};
+static const iocshArg arg4 = {"baud",iocshArgInt};
+static const iocshArg* args[]= {&arg0,&arg1,&arg2,&arg3,&arg4};
 static const iocshFuncDef drvAsynKeithley648xFuncDef = 
-  {"drvAsynKeithley648x",4,args};
+  {"drvAsynKeithley648x",5,args};
 static void drvAsynKeithley648xCallFunc(const iocshArgBuf* args)
 {
-  drvAsynKeithley648x(args[0].sval,args[1].sval,args[2].sval,args[3].ival);
+  drvAsynKeithley648x(args[0].sval,args[1].sval,args[2].sval,args[3].ival,
+                      args[4].ival);
+}
+
+static const iocshArg engineArg0 = {"workers",iocshArgInt};
+static const iocshArg* engineArgs[]= {&engineArg0};
+static const iocshFuncDef drvAsynKeithley648xEngineFuncDef = 
+  {"drvAsynKeithley648xEngine",1,engineArgs};
+static void drvAsynKeithley648xEngineCallFunc(const iocshArgBuf* args)
+{
+  drvAsynKeithley648xEngine(args[0].ival);
+}
+
+static const iocshArg deadbandArg0 = {"myport",iocshArgString};
+static const iocshArg deadbandArg1 = {"tag",iocshArgString};
+static const iocshArg deadbandArg2 = {"absolute",iocshArgDouble};
+static const iocshArg deadbandArg3 = {"relative",iocshArgDouble};
+static const iocshArg deadbandArg4 = {"maxRate",iocshArgDouble};
+static const iocshArg* deadbandArgs[]= {&deadbandArg0,&deadbandArg1,
+                                        &deadbandArg2,&deadbandArg3,
+                                        &deadbandArg4};
+static const iocshFuncDef drvAsynKeithley648xDeadbandFuncDef = 
+  {"drvAsynKeithley648xDeadband",5,deadbandArgs};
+static void drvAsynKeithley648xDeadbandCallFunc(const iocshArgBuf* args)
+{
+  drvAsynKeithley648xDeadband(args[0].sval,args[1].sval,args[2].dval,
+                              args[3].dval,args[4].dval);
+}
+
+static const iocshArg dumpArg0 = {"myport",iocshArgString};
+static const iocshArg dumpArg1 = {"count",iocshArgInt};
+static const iocshArg* dumpArgs[]= {&dumpArg0,&dumpArg1};
+static const iocshFuncDef drvAsynKeithley648xDumpFuncDef = 
+  {"drvAsynKeithley648xDump",2,dumpArgs};
+static void drvAsynKeithley648xDumpCallFunc(const iocshArgBuf* args)
+{
+  drvAsynKeithley648xDump(args[0].sval,args[1].ival);
+}
+
+static const iocshArg autoDumpArg0 = {"myport",iocshArgString};
+static const iocshArg autoDumpArg1 = {"enable",iocshArgInt};
+static const iocshArg* autoDumpArgs[]= {&autoDumpArg0,&autoDumpArg1};
+static const iocshFuncDef drvAsynKeithley648xAutoDumpFuncDef = 
+  {"drvAsynKeithley648xAutoDump",2,autoDumpArgs};
+static void drvAsynKeithley648xAutoDumpCallFunc(const iocshArgBuf* args)
+{
+  drvAsynKeithley648xAutoDump(args[0].sval,args[1].ival);
+}
+
+static const iocshArg responseArg0 = {"myport",iocshArgString};
+static const iocshArg responseArg1 = {"file",iocshArgString};
+static const iocshArg* responseArgs[]= {&responseArg0,&responseArg1};
+static const iocshFuncDef drvAsynKeithley648xResponseFuncDef = 
+  {"drvAsynKeithley648xResponse",2,responseArgs};
+static void drvAsynKeithley648xResponseCallFunc(const iocshArgBuf* args)
+{
+  drvAsynKeithley648xResponse(args[0].sval,args[1].sval);
+}
+
+static const iocshArg benchArg0 = {"myport",iocshArgString};
+static const iocshArg benchArg1 = {"tag",iocshArgString};
+static const iocshArg benchArg2 = {"iface",iocshArgString};
+static const iocshArg benchArg3 = {"loops",iocshArgInt};
+static const iocshArg* benchArgs[]= {&benchArg0,&benchArg1,&benchArg2,
+                                     &benchArg3};
+static const iocshFuncDef drvAsynKeithley648xBenchFuncDef = 
+  {"drvAsynKeithley648xBench",4,benchArgs};
+static void drvAsynKeithley648xBenchCallFunc(const iocshArgBuf* args)
+{
+  drvAsynKeithley648xBench(args[0].sval,args[1].sval,args[2].sval,
+                           args[3].ival);
+}
+
+static const iocshArg tuneArg0 = {"myport",iocshArgString};
+static const iocshArg tuneArg1 = {"noise",iocshArgDouble};
+static const iocshArg tuneArg2 = {"readings",iocshArgInt};
+static const iocshArg* tuneArgs[]= {&tuneArg0,&tuneArg1,&tuneArg2};
+static const iocshFuncDef drvAsynKeithley648xTuneFuncDef = 
+  {"drvAsynKeithley648xTune",3,tuneArgs};
+static void drvAsynKeithley648xTuneCallFunc(const iocshArgBuf* args)
+{
+  drvAsynKeithley648xTune(args[0].sval,args[1].dval,args[2].ival);
 }
 
 /* Registration method */
@@ -1335,6 +6233,20 @@ static void drvAsynKeithley648xRegister(void)
     {
       firstTime = 0;
       iocshRegister( &drvAsynKeithley648xFuncDef,drvAsynKeithley648xCallFunc );
+      iocshRegister( &drvAsynKeithley648xEngineFuncDef,
+                     drvAsynKeithley648xEngineCallFunc );
+      iocshRegister( &drvAsynKeithley648xDeadbandFuncDef,
+                     drvAsynKeithley648xDeadbandCallFunc );
+      iocshRegister( &drvAsynKeithley648xDumpFuncDef,
+                     drvAsynKeithley648xDumpCallFunc );
+      iocshRegister( &drvAsynKeithley648xAutoDumpFuncDef,
+                     drvAsynKeithley648xAutoDumpCallFunc );
+      iocshRegister( &drvAsynKeithley648xResponseFuncDef,
+                     drvAsynKeithley648xResponseCallFunc );
+      iocshRegister( &drvAsynKeithley648xBenchFuncDef,
+                     drvAsynKeithley648xBenchCallFunc );
+      iocshRegister( &drvAsynKeithley648xTuneFuncDef,
+                     drvAsynKeithley648xTuneCallFunc );
     }
 }
 epicsExportRegistrar( drvAsynKeithley648xRegister );
@@ -0,0 +1,394 @@
+/*
+ Description
+    In-process mock of a 6485/6487 on an asynOctet port, so the driver's
+    parsing and dispatch can be exercised and timed without a serial line
+    or an instrument. Calling
+
+        k648xMockPort(portName,script,latency)
+
+    before drvAsynKeithley648x() registers portName, which answers the
+    queries listed in the script file after latency seconds (0 answers at
+    once, in the caller's thread). Each script line holds a query and its
+    reply separated by white space, '#' starting a comment:
+
+        *IDN?       KEITHLEY INSTRUMENTS INC.,MODEL 6485,1234567,...
+        READ?       +1.000000E-09A,+1.000,+0.000000E+00
+        READ?       +1.010000E-09A,+1.100,+0.000000E+00
+
+    A query listed more than once cycles through its replies. A ';'
+    separated line is answered part by part the way the instrument does,
+    a setting written as "KEY VALUE" becomes the reply to "KEY?", and a
+    query missing from the script is answered "0" and counted. It is
+    only built into the k648xTest program, which runs the driver's unit
+    tests against it and times it with drvAsynKeithley648xBench().
+*/
+
+
+/* System related include files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* EPICS system related include files */
+#include <epicsStdio.h>
+#include <cantProceed.h>
+#include <epicsString.h>
+#include <errlog.h>
+#include <epicsThread.h>
+
+/* EPICS synApps/Asyn related include files */
+#include <asynDriver.h>
+#include <asynOctet.h>
+
+#include "k648xMock.h"
+
+
+#define MOCK_ENTRIES  (256)
+#define MOCK_COMMAND  (40)
+#define MOCK_REPLY    (100)
+#define MOCK_PENDING  (256)
+
+
+static const char *driver = "k648xMock";
+
+struct MockEntry
+{
+  char command[MOCK_COMMAND];
+  char reply[MOCK_REPLY];
+  int next;               // next reply to the same query, -1 for none
+  int current;            // first entry only: the reply given next
+};
+
+struct Mock
+{
+  char *portName;
+  char *script;
+  double latency;
+  MockEntry entry[MOCK_ENTRIES];
+  int count;
+  char pending[MOCK_PENDING];   // last line written, answered by read
+  int writes;
+  int reads;
+  int misses;
+};
+
+
+/* Forward references for asynCommon methods */
+static void report(void* ppvt,FILE* fp,int details);
+static asynStatus connect(void* ppvt,asynUser* pasynUser);
+static asynStatus disconnect(void* ppvt,asynUser* pasynUser);
+static asynCommon ifaceCommon = {report,connect,disconnect};
+
+/* Forward references for asynOctet methods */
+static asynStatus writeOctet( void* ppvt, asynUser* pasynUser,
+                              const char *data, size_t numchars,
+                              size_t* nbytes);
+static asynStatus readOctet( void* ppvt, asynUser* pasynUser, char* data,
+                             size_t maxchars, size_t *nbytes, int *eom);
+static asynStatus flushOctet( void *ppvt, asynUser* pasynUser);
+static asynOctet ifaceOctet = { writeOctet, readOctet, flushOctet};
+
+/* Forward references for script methods */
+static MockEntry *findEntry(Mock *pmock, const char *command);
+static MockEntry *addEntry(Mock *pmock, const char *command,
+                           const char *reply);
+static void answer(Mock *pmock, char *reply, size_t size);
+
+
+
+
+/****************************************************************************
+ * Define public interface methods
+ ****************************************************************************/
+int k648xMockPort(const char *portName, const char *script, double latency)
+{
+  Mock *pmock;
+  asynInterface *pcommon, *poctet;
+  FILE *fp;
+  char line[MOCK_COMMAND + MOCK_REPLY];
+  char *str, *end;
+  int lineNumber = 0;
+  asynStatus status;
+
+  fp = fopen( script, "r");
+  if( fp == NULL)
+    {
+      errlogPrintf("%s::k648xMockPort can't open %s\n", driver, script);
+      return asynError;
+    }
+
+  pmock = (Mock *) callocMustSucceed( 1, sizeof(Mock), "k648xMockPort");
+  pmock->portName = epicsStrDup( portName);
+  pmock->script = epicsStrDup( script);
+  pmock->latency = (latency > 0.0) ? latency : 0.0;
+
+  while( fgets( line, sizeof(line), fp) )
+    {
+      lineNumber++;
+      str = line + strspn( line, " \t");
+      if( (*str == '#') || (*str == '\r') || (*str == '\n') || !*str)
+        continue;
+      str[strcspn( str, "\r\n")] = '\0';
+
+      end = str + strcspn( str, " \t");
+      if( *end)
+        *end++ = '\0';
+      end += strspn( end, " \t");
+      if( addEntry( pmock, str, end) == NULL)
+        {
+          errlogPrintf("%s::k648xMockPort %s line %d: too long, or more "
+                       "than %d lines\n", driver, script, lineNumber,
+                       MOCK_ENTRIES);
+          fclose( fp);
+          return asynError;
+        }
+    }
+  fclose( fp);
+
+  // answer in the caller's thread unless replies take time
+  status = pasynManager->registerPort( portName,
+                                       (pmock->latency > 0.0) ?
+                                       ASYN_CANBLOCK : 0, 1, 0, 0);
+  if( status != asynSuccess)
+    {
+      errlogPrintf("%s::k648xMockPort can't register port %s\n", driver,
+                   portName);
+      return asynError;
+    }
+
+  pcommon = (asynInterface *) callocMustSucceed( 2, sizeof(asynInterface),
+                                                 "k648xMockPort");
+  poctet = pcommon + 1;
+  pcommon->interfaceType = asynCommonType;
+  pcommon->pinterface = (void *) &ifaceCommon;
+  pcommon->drvPvt = pmock;
+  poctet->interfaceType = asynOctetType;
+  poctet->pinterface = (void *) &ifaceOctet;
+  poctet->drvPvt = pmock;
+
+  if( (pasynManager->registerInterface( portName, pcommon) != asynSuccess) ||
+      (pasynOctetBase->initialize( portName, poctet, 0, 0, 0) != asynSuccess))
+    {
+      errlogPrintf("%s::k648xMockPort can't register interfaces of %s\n",
+                   driver, portName);
+      return asynError;
+    }
+
+  return asynSuccess;
+}
+
+
+
+
+/****************************************************************************
+ * Define private script methods
+ ****************************************************************************/
+
+/* First entry for command, queries compared without leading ':' or case */
+static MockEntry *findEntry(Mock *pmock, const char *command)
+{
+  int i;
+
+  command += strspn( command, ":");
+  for( i = 0; i < pmock->count; i++)
+    if( !epicsStrCaseCmp( pmock->entry[i].command, command) )
+      return &pmock->entry[i];
+
+  return NULL;
+}
+
+
+static MockEntry *addEntry(Mock *pmock, const char *command,
+                           const char *reply)
+{
+  MockEntry *pfirst, *pent;
+
+  command += strspn( command, ":");
+  if( (pmock->count == MOCK_ENTRIES) || (strlen(command) >= MOCK_COMMAND) ||
+      (strlen(reply) >= MOCK_REPLY) )
+    return NULL;
+
+  pfirst = findEntry( pmock, command);
+  pent = &pmock->entry[pmock->count];
+  strcpy( pent->command, command);
+  strcpy( pent->reply, reply);
+  pent->next = -1;
+  pent->current = pmock->count;
+
+  // append to the cycle of replies to the same query
+  if( pfirst)
+    {
+      while( pfirst->next >= 0)
+        pfirst = &pmock->entry[pfirst->next];
+      pfirst->next = pmock->count;
+    }
+  pmock->count++;
+
+  return pent;
+}
+
+
+/* Answer the pending line part by part, ';' separated */
+static void answer(Mock *pmock, char *reply, size_t size)
+{
+  MockEntry *pfirst, *pent;
+  char *str, *saveptr;
+  const char *value;
+  size_t len = 0;
+
+  reply[0] = '\0';
+  for( str = epicsStrtok_r( pmock->pending, ";", &saveptr); str;
+       str = epicsStrtok_r( NULL, ";", &saveptr) )
+    {
+      str += strspn( str, " :");
+      if( strchr( str, '?') == NULL)
+        continue;
+
+      pfirst = findEntry( pmock, str);
+      if( pfirst)
+        {
+          pent = &pmock->entry[pfirst->current];
+          pfirst->current = (pent->next >= 0) ? pent->next :
+            (int) (pfirst - pmock->entry);
+          value = pent->reply;
+        }
+      else
+        {
+          pmock->misses++;
+          value = "0";
+        }
+      len += epicsSnprintf( reply + len, (len < size) ? size - len : 0,
+                            "%s%s", len ? ";" : "", value);
+    }
+  pmock->pending[0] = '\0';
+}
+
+
+
+
+/****************************************************************************
+ * Define private interface asynCommon methods
+ ****************************************************************************/
+static void report(void* ppvt,FILE* fp,int details)
+{
+  Mock *pmock = (Mock *) ppvt;
+
+  fprintf( fp, "k648x mock port: %s\n", pmock->portName);
+  if( details)
+    {
+      fprintf( fp, "    script:     %s, %d lines\n", pmock->script,
+               pmock->count);
+      fprintf( fp, "    latency:    %g s\n", pmock->latency);
+      fprintf( fp, "    served:     %d writes, %d reads, %d unknown "
+               "queries\n", pmock->writes, pmock->reads, pmock->misses);
+    }
+}
+
+
+static asynStatus connect(void* ppvt,asynUser* pasynUser)
+{
+  pasynManager->exceptionConnect(pasynUser);
+  return asynSuccess;
+}
+
+
+static asynStatus disconnect(void* ppvt,asynUser* pasynUser)
+{
+  pasynManager->exceptionDisconnect(pasynUser);
+  return asynSuccess;
+}
+
+
+
+
+/****************************************************************************
+ * Define private interface asynOctet methods
+ ****************************************************************************/
+static asynStatus writeOctet( void* ppvt, asynUser* pasynUser,
+                              const char *data, size_t numchars,
+                              size_t* nbytes)
+{
+  Mock *pmock = (Mock *) ppvt;
+  MockEntry *pent;
+  char line[MOCK_PENDING];
+  char *str, *value, *saveptr;
+  char key[MOCK_COMMAND];
+  size_t len;
+
+  len = (numchars < MOCK_PENDING - 1) ? numchars : MOCK_PENDING - 1;
+  memcpy( pmock->pending, data, len);
+  pmock->pending[len] = '\0';
+  pmock->pending[strcspn( pmock->pending, "\r\n")] = '\0';
+  pmock->writes++;
+
+  // "KEY VALUE" settings become the replies to "KEY?"
+  strcpy( line, pmock->pending);
+  for( str = epicsStrtok_r( line, ";", &saveptr); str;
+       str = epicsStrtok_r( NULL, ";", &saveptr) )
+    {
+      str += strspn( str, " :");
+      len = strcspn( str, " ?");
+      if( (str[len] != ' ') || (len + 2 > MOCK_COMMAND) )
+        continue;
+      memcpy( key, str, len);
+      strcpy( key + len, "?");
+      value = str + len + 1;
+      value += strspn( value, " ");
+
+      pent = findEntry( pmock, key);
+      if( pent && (strlen(value) < MOCK_REPLY) )
+        {
+          strcpy( pent->reply, value);
+          pent->next = -1;
+          pent->current = (int) (pent - pmock->entry);
+        }
+      else if( pent == NULL)
+        addEntry( pmock, key, value);
+    }
+
+  *nbytes = numchars;
+  return asynSuccess;
+}
+
+
+static asynStatus readOctet( void* ppvt, asynUser* pasynUser, char* data,
+                             size_t maxchars, size_t *nbytes, int *eom)
+{
+  Mock *pmock = (Mock *) ppvt;
+  char reply[MOCK_PENDING];
+  size_t len;
+
+  *nbytes = 0;
+  if( pmock->latency > 0.0)
+    epicsThreadSleep( pmock->latency);
+
+  answer( pmock, reply, sizeof(reply));
+  if( reply[0] == '\0')
+    {
+      epicsSnprintf( pasynUser->errorMessage, pasynUser->errorMessageSize,
+                     "%s no query pending", pmock->portName);
+      return asynTimeout;
+    }
+  pmock->reads++;
+
+  len = strlen( reply);
+  if( len > maxchars)
+    len = maxchars;
+  memcpy( data, reply, len);
+  if( len < maxchars)
+    data[len] = '\0';
+  *nbytes = len;
+  if( eom)
+    *eom = ASYN_EOM_END;
+
+  return asynSuccess;
+}
+
+
+static asynStatus flushOctet( void *ppvt, asynUser* pasynUser)
+{
+  Mock *pmock = (Mock *) ppvt;
+
+  pmock->pending[0] = '\0';
+  return asynSuccess;
+}
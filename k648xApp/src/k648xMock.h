@@ -0,0 +1,14 @@
+/*
+ Description
+    In-process mock of a 6485/6487 on an asynOctet port, for the unit
+    tests and microbenchmarks of the k648xTest program; see k648xMock.cpp.
+*/
+
+#ifndef K648XMOCK_H
+#define K648XMOCK_H
+
+/* Register asynOctet port portName answering the queries of the script
+   file after latency seconds (0 at once); asynSuccess or asynError */
+int k648xMockPort(const char *portName, const char *script, double latency);
+
+#endif /* K648XMOCK_H */
@@ -0,0 +1,298 @@
+/*
+ Description
+    Vectorized reductions over reading arrays, see k648xReduce.h. The
+    kernel set is chosen on first use from what the CPU supports. The
+    microbenchmark
+
+        k648xReduceBench(points,loops)
+
+    can be called from the IOC shell to compare the selected kernels with
+    the scalar loops.
+*/
+
+
+/* System related include files */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* EPICS system related include files */
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <cantProceed.h>
+#include <epicsExport.h>
+
+#include "k648xReduce.h"
+
+/* x86 kernels need GCC 4.9 for target attributes and cpu detection */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+    ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define K648X_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+
+typedef void (*ReduceFunc)(const double *x, size_t n, k648xStats *pstats);
+
+struct Kernels
+{
+  const char *name;
+  ReduceFunc reduce;
+};
+
+
+/****************************************************************************
+ * Define scalar kernels
+ ****************************************************************************/
+/* The vector min/max instructions and the scalar compares disagree on
+   where a NaN ends up, so a NaN reading (seen in the sum) makes all the
+   statistics NaN whichever kernel ran */
+static void finishStats(double sum, double sumsq, double min, double max,
+                        size_t n, k648xStats *pstats)
+{
+  if( sum != sum)
+    min = max = sum;
+  pstats->mean = sum / n;
+  pstats->rms = sqrt( sumsq / n);
+  pstats->min = min;
+  pstats->max = max;
+  pstats->p2p = max - min;
+}
+
+static void reduceScalar(const double *x, size_t n, k648xStats *pstats)
+{
+  double sum = 0.0, sumsq = 0.0, min = x[0], max = x[0];
+  size_t i;
+
+  for( i = 0; i < n; i++)
+    {
+      sum += x[i];
+      sumsq += x[i] * x[i];
+      if( x[i] < min)
+        min = x[i];
+      if( x[i] > max)
+        max = x[i];
+    }
+
+  finishStats( sum, sumsq, min, max, n, pstats);
+}
+
+
+/****************************************************************************
+ * Define x86 vector kernels
+ ****************************************************************************/
+#ifdef K648X_X86_KERNELS
+
+__attribute__((target("sse2")))
+static void reduceSSE2(const double *x, size_t n, k648xStats *pstats)
+{
+  __m128d vsum = _mm_setzero_pd(), vsumsq = _mm_setzero_pd();
+  __m128d vmin = _mm_set1_pd(x[0]), vmax = _mm_set1_pd(x[0]);
+  __m128d v;
+  double lane[2], sum, sumsq, min, max;
+  size_t i;
+
+  for( i = 0; i + 2 <= n; i += 2)
+    {
+      v = _mm_loadu_pd(x + i);
+      vsum = _mm_add_pd(vsum, v);
+      vsumsq = _mm_add_pd(vsumsq, _mm_mul_pd(v, v));
+      vmin = _mm_min_pd(vmin, v);
+      vmax = _mm_max_pd(vmax, v);
+    }
+
+  _mm_storeu_pd(lane, vsum);
+  sum = lane[0] + lane[1];
+  _mm_storeu_pd(lane, vsumsq);
+  sumsq = lane[0] + lane[1];
+  _mm_storeu_pd(lane, vmin);
+  min = (lane[0] < lane[1]) ? lane[0] : lane[1];
+  _mm_storeu_pd(lane, vmax);
+  max = (lane[0] > lane[1]) ? lane[0] : lane[1];
+
+  for( ; i < n; i++)
+    {
+      sum += x[i];
+      sumsq += x[i] * x[i];
+      if( x[i] < min)
+        min = x[i];
+      if( x[i] > max)
+        max = x[i];
+    }
+
+  finishStats( sum, sumsq, min, max, n, pstats);
+}
+
+__attribute__((target("avx2")))
+static void reduceAVX2(const double *x, size_t n, k648xStats *pstats)
+{
+  // two accumulators per quantity hide the add latency
+  __m256d vsum0 = _mm256_setzero_pd(), vsum1 = _mm256_setzero_pd();
+  __m256d vsq0 = _mm256_setzero_pd(), vsq1 = _mm256_setzero_pd();
+  __m256d vmin = _mm256_set1_pd(x[0]), vmax = _mm256_set1_pd(x[0]);
+  __m256d v0, v1;
+  double lane[4], sum, sumsq, min, max;
+  size_t i;
+  int j;
+
+  for( i = 0; i + 8 <= n; i += 8)
+    {
+      v0 = _mm256_loadu_pd(x + i);
+      v1 = _mm256_loadu_pd(x + i + 4);
+      vsum0 = _mm256_add_pd(vsum0, v0);
+      vsum1 = _mm256_add_pd(vsum1, v1);
+      vsq0 = _mm256_add_pd(vsq0, _mm256_mul_pd(v0, v0));
+      vsq1 = _mm256_add_pd(vsq1, _mm256_mul_pd(v1, v1));
+      vmin = _mm256_min_pd(vmin, _mm256_min_pd(v0, v1));
+      vmax = _mm256_max_pd(vmax, _mm256_max_pd(v0, v1));
+    }
+
+  _mm256_storeu_pd(lane, _mm256_add_pd(vsum0, vsum1));
+  sum = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+  _mm256_storeu_pd(lane, _mm256_add_pd(vsq0, vsq1));
+  sumsq = (lane[0] + lane[1]) + (lane[2] + lane[3]);
+  _mm256_storeu_pd(lane, vmin);
+  min = lane[0];
+  for( j = 1; j < 4; j++)
+    if( lane[j] < min)
+      min = lane[j];
+  _mm256_storeu_pd(lane, vmax);
+  max = lane[0];
+  for( j = 1; j < 4; j++)
+    if( lane[j] > max)
+      max = lane[j];
+
+  for( ; i < n; i++)
+    {
+      sum += x[i];
+      sumsq += x[i] * x[i];
+      if( x[i] < min)
+        min = x[i];
+      if( x[i] > max)
+        max = x[i];
+    }
+
+  finishStats( sum, sumsq, min, max, n, pstats);
+}
+
+#endif /* K648X_X86_KERNELS */
+
+
+/****************************************************************************
+ * Define kernel selection and public methods
+ ****************************************************************************/
+static const Kernels scalarKernels = { "scalar", reduceScalar };
+#ifdef K648X_X86_KERNELS
+static const Kernels sse2Kernels = { "sse2", reduceSSE2 };
+static const Kernels avx2Kernels = { "avx2", reduceAVX2 };
+#endif
+
+static const Kernels *kernels = NULL;
+
+static const Kernels *selectKernels(void)
+{
+  // racing first calls all store the same answer
+  if( kernels == NULL)
+    {
+      kernels = &scalarKernels;
+#ifdef K648X_X86_KERNELS
+      __builtin_cpu_init();
+      if( __builtin_cpu_supports("avx2"))
+        kernels = &avx2Kernels;
+      else if( __builtin_cpu_supports("sse2"))
+        kernels = &sse2Kernels;
+#endif
+    }
+
+  return kernels;
+}
+
+void k648xReduce(const double *x, size_t n, k648xStats *pstats)
+{
+  if( n == 0)
+    {
+      pstats->mean = pstats->rms = pstats->min = pstats->max = 0.0;
+      pstats->p2p = 0.0;
+      return;
+    }
+
+  selectKernels()->reduce( x, n, pstats);
+}
+
+const char *k648xReduceKernel(void)
+{
+  return selectKernels()->name;
+}
+
+
+/****************************************************************************
+ * Define microbenchmark
+ ****************************************************************************/
+static double benchReduce(ReduceFunc func, const double *x, size_t n, 
+                          int loops, k648xStats *pstats)
+{
+  epicsTimeStamp start, end;
+  int i;
+
+  epicsTimeGetCurrent( &start);
+  for( i = 0; i < loops; i++)
+    func( x, n, pstats);
+  epicsTimeGetCurrent( &end);
+
+  return epicsTimeDiffInSeconds( &end, &start) / loops;
+}
+
+static void k648xReduceBench(int points, int loops)
+{
+  const Kernels *pk = selectKernels();
+  k648xStats ref, vec;
+  double *x, tref, tvec;
+  int i;
+
+  if( points <= 0)
+    points = 4096;
+  if( loops <= 0)
+    loops = 1000;
+
+  x = (double *) callocMustSucceed( points, sizeof(double), "k648xReduceBench");
+
+  // picoampere scale readings with some noise
+  for( i = 0; i < points; i++)
+    x[i] = 1.0e-12 * (1.0 + 0.01 * ((rand() % 2001) - 1000) / 1000.0);
+
+  tref = benchReduce( scalarKernels.reduce, x, points, loops, &ref);
+  tvec = benchReduce( pk->reduce, x, points, loops, &vec);
+  printf("reduce  %d points: scalar %.3f us, %s %.3f us (x%.1f)\n", points,
+         tref * 1e6, pk->name, tvec * 1e6, (tvec > 0.0) ? tref / tvec : 0.0);
+  printf("        mean %g/%g rms %g/%g p2p %g/%g\n", ref.mean, vec.mean, 
+         ref.rms, vec.rms, ref.p2p, vec.p2p);
+
+  free( x);
+}
+
+
+/****************************************************************************
+ * Register public methods
+ ****************************************************************************/
+static const iocshArg benchArg0 = {"points",iocshArgInt};
+static const iocshArg benchArg1 = {"loops",iocshArgInt};
+static const iocshArg* benchArgs[]= {&benchArg0,&benchArg1};
+static const iocshFuncDef k648xReduceBenchFuncDef = 
+  {"k648xReduceBench",2,benchArgs};
+static void k648xReduceBenchCallFunc(const iocshArgBuf* args)
+{
+  k648xReduceBench(args[0].ival,args[1].ival);
+}
+
+/* Registration method */
+static void k648xReduceRegister(void)
+{
+  static int firstTime = 1;
+
+  if( firstTime )
+    {
+      firstTime = 0;
+      iocshRegister( &k648xReduceBenchFuncDef,k648xReduceBenchCallFunc );
+    }
+}
+epicsExportRegistrar( k648xReduceRegister );
@@ -0,0 +1,28 @@
+/*
+ Description
+    Reductions over arrays of picoammeter readings, with
+    SSE2 and AVX2 kernels selected at run time on x86 and a scalar fallback
+    everywhere else.
+*/
+
+#ifndef K648XREDUCE_H
+#define K648XREDUCE_H
+
+#include <stddef.h>
+
+struct k648xStats
+{
+  double mean;
+  double rms;
+  double min;
+  double max;
+  double p2p;
+};
+
+/* Statistics of x[0..n-1]; all zero when n is 0, all NaN when any x is */
+void k648xReduce(const double *x, size_t n, k648xStats *pstats);
+
+/* Name of the kernel set selected for this CPU */
+const char *k648xReduceKernel(void);
+
+#endif /* K648XREDUCE_H */
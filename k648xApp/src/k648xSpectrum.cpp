@@ -0,0 +1,156 @@
+/*
+ Description
+    Noise spectra of reading arrays, see k648xSpectrum.h. The FFT is an
+    in-place iterative radix-2 transform with the twiddle factors of each
+    stage generated by recurrence, so no external library is needed.
+*/
+
+
+/* System related include files */
+#include <math.h>
+
+#include "k648xSpectrum.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+/****************************************************************************
+ * Define FFT
+ ****************************************************************************/
+static void fft(double *re, double *im, size_t n)
+{
+  double tr, ti, wr, wi, wpr, wpi, t;
+  size_t i, j, k, len, half;
+
+  // bit reversed order
+  for( i = 1, j = 0; i < n; i++)
+    {
+      for( k = n >> 1; j & k; k >>= 1)
+        j ^= k;
+      j |= k;
+      if( i < j)
+        {
+          t = re[i]; re[i] = re[j]; re[j] = t;
+          t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+  for( len = 2; len <= n; len <<= 1)
+    {
+      half = len >> 1;
+      wpr = cos( -2.0 * M_PI / len);
+      wpi = sin( -2.0 * M_PI / len);
+      wr = 1.0;
+      wi = 0.0;
+      for( k = 0; k < half; k++)
+        {
+          for( i = k; i < n; i += len)
+            {
+              j = i + half;
+              tr = wr * re[j] - wi * im[j];
+              ti = wr * im[j] + wi * re[j];
+              re[j] = re[i] - tr;
+              im[j] = im[i] - ti;
+              re[i] += tr;
+              im[i] += ti;
+            }
+          t = wr;
+          wr = wr * wpr - wi * wpi;
+          wi = t * wpi + wi * wpr;
+        }
+    }
+}
+
+
+/* Periodic Hann window, the usual choice for Welch averaging */
+static double hann(size_t i, size_t n)
+{
+  return 0.5 - 0.5 * cos( 2.0 * M_PI * i / n);
+}
+
+
+/****************************************************************************
+ * Define public methods
+ ****************************************************************************/
+double k648xResample(const double *x, const double *t, size_t n,
+                     double *out)
+{
+  double dt, at, f;
+  size_t i, j;
+
+  if( (n < 2) || !(t[n - 1] > t[0]) )
+    return 0.0;
+
+  dt = (t[n - 1] - t[0]) / (n - 1);
+  out[0] = x[0];
+  for( i = 1, j = 0; i < n; i++)
+    {
+      at = t[0] + i * dt;
+      while( (j + 2 < n) && (t[j + 1] <= at) )
+        j++;
+      // repeated timestamps (e.g. 1 ms resolution) take the later reading
+      if( t[j + 1] > t[j])
+        {
+          f = (at - t[j]) / (t[j + 1] - t[j]);
+          if( f < 0.0)
+            f = 0.0;
+          if( f > 1.0)
+            f = 1.0;
+          out[i] = x[j] + f * (x[j + 1] - x[j]);
+        }
+      else
+        out[i] = x[j + 1];
+    }
+
+  return dt;
+}
+
+int k648xWelch(const double *x, size_t n, double dt, size_t segment,
+               double *psd, double *work)
+{
+  double *re = work, *im = work + segment;
+  double w, wsum = 0.0, mean, scale;
+  size_t start, half, i, k;
+  int count = 0;
+
+  if( (segment < 2) || (segment & (segment - 1)) || (n < segment) ||
+      (dt <= 0.0) )
+    return 0;
+
+  half = segment / 2;
+  for( k = 0; k <= half; k++)
+    psd[k] = 0.0;
+  for( i = 0; i < segment; i++)
+    {
+      w = hann( i, segment);
+      wsum += w * w;
+    }
+
+  for( start = 0; start + segment <= n; start += half)
+    {
+      mean = 0.0;
+      for( i = 0; i < segment; i++)
+        mean += x[start + i];
+      mean /= segment;
+
+      for( i = 0; i < segment; i++)
+        {
+          re[i] = (x[start + i] - mean) * hann( i, segment);
+          im[i] = 0.0;
+        }
+      fft( re, im, segment);
+
+      for( k = 0; k <= half; k++)
+        psd[k] += re[k] * re[k] + im[k] * im[k];
+      count++;
+    }
+
+  // one-sided: every bin but DC and Nyquist also holds the negative side
+  scale = dt / (wsum * count);
+  for( k = 0; k <= half; k++)
+    psd[k] *= ((k == 0) || (k == half)) ? scale : 2.0 * scale;
+
+  return count;
+}
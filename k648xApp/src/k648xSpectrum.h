@@ -0,0 +1,28 @@
+/*
+ Description
+    Noise spectra of picoammeter readings: resampling of irregularly
+    timestamped readings to uniform spacing and Welch averaged power
+    spectral densities over a self-contained radix-2 FFT.
+*/
+
+#ifndef K648XSPECTRUM_H
+#define K648XSPECTRUM_H
+
+#include <stddef.h>
+
+/* Linearly interpolate the n readings x taken at the non-decreasing
+   times t (s) onto n evenly spaced times from t[0] to t[n-1]; returns
+   the spacing in seconds, 0 if the times don't span an interval */
+double k648xResample(const double *x, const double *t, size_t n,
+                     double *out);
+
+/* One-sided power spectral density (units of x squared per Hz) of the n
+   uniformly spaced readings x, dt seconds apart, averaged over Hann
+   windowed segments of length segment (a power of two) overlapping by
+   half, each with its mean removed. psd receives segment/2+1 values for
+   the frequencies k/(segment*dt); work holds 2*segment doubles. Returns
+   the number of segments averaged, 0 if n is shorter than a segment */
+int k648xWelch(const double *x, size_t n, double dt, size_t segment,
+               double *psd, double *work);
+
+#endif /* K648XSPECTRUM_H */
@@ -0,0 +1,251 @@
+/*
+ Description
+    Unit tests of the driver's READ? reply parsing, and of tag creation
+    and dispatch through the in-process mock port of k648xMock.cpp,
+    finishing with a drvAsynKeithley648xBench() run against it. The
+    driver source is included so its static methods can be reached.
+    Built as a host test program, run by "make runtests" from the
+    O.<arch> directory the mock script is found above.
+*/
+
+
+/* System related include files */
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* EPICS system related include files */
+#include <epicsUnitTest.h>
+#include <testMain.h>
+
+#include "drvAsynKeithley648x.cpp"
+#include "k648xMock.h"
+
+
+#define TEST_SCRIPT "../mock6485.txt"
+#define TEST_PORT   "testCA"
+#define TEST_MOCK   "testMock"
+
+
+/* Relative comparison, readings are printed to 7 digits */
+static int near(double a, double b)
+{
+  return fabs( a - b) <= 1e-6 * fabs( b);
+}
+
+
+/****************************************************************************
+ * Define parsing tests
+ ****************************************************************************/
+static void testParseReading(void)
+{
+  char buf[BUFFER_SIZE];
+  Reading rd;
+
+  strcpy( buf, "+1.234000E-09A");
+  testOk( parseReading( buf, &rd) == 0, "reading only reply parses");
+  testOk( near( rd.reading, 1.234e-9) && (rd.status == 0) &&
+          (rd.burst == 0), "reading only reply value and status");
+
+  strcpy( buf, "-9.900000E+37A");
+  testOk( (parseReading( buf, &rd) == 0) && (rd.status == 1),
+          "reading only overflow sets the overflow bit");
+
+  strcpy( buf, "-2.500000E-12A,+12.345,+1.024000E+03");
+  testOk( parseReading( buf, &rd) == 0, "three element reply parses");
+  testOk( near( rd.reading, -2.5e-12) && near( rd.timestamp, 12.345) &&
+          (rd.status == 1024), "three element reply value, time and status");
+
+  strcpy( buf, "+1.000000E-09A,+1.000");
+  testOk( parseReading( buf, &rd) == -1, "two element reply is refused");
+}
+
+
+static void testParseReadings(void)
+{
+  char buf[BURST_BUFFER];
+  Reading rd[BURST_MAX];
+  Port port;
+  size_t len;
+  int i;
+
+  memset( &port, 0, sizeof(port));
+  port.lock = epicsMutexMustCreate();
+  port.settings = resetSettings;
+
+  strcpy( buf, "+5.000000E-09A,+2.000,+0.000000E+00");
+  testOk( parseReadings( &port, buf, rd, 1) == 1,
+          "single reading through parseReadings");
+  testOk( near( rd[0].reading, 5e-9) && (rd[0].burst == 0),
+          "single reading is not a burst");
+
+  strcpy( buf, "+1.000000E-09A,+1.000,+0.000000E+00,"
+          "+2.000000E-09A,+1.100,+0.000000E+00,"
+          "+9.900000E+37A,+1.200,+1.000000E+00");
+  testOk( parseReadings( &port, buf, rd, 3) == 3,
+          "three element burst of 3 parses");
+  testOk( near( rd[0].reading, 1e-9) && near( rd[1].reading, 2e-9) &&
+          near( rd[1].timestamp, 1.1) && (rd[2].status == 1),
+          "burst values, times and status");
+  testOk( (rd[0].burst == -1) && (rd[1].burst == -1) && (rd[2].burst == 3),
+          "burst marks its last reading with the count");
+
+  strcpy( buf, "+7.000000E-09A,+3.000,+0.000000E+00");
+  testOk( parseReadings( &port, buf, rd, 4) == 1,
+          "burst reply holding one reading is taken");
+
+  strcpy( buf, "+1.000000E-09A,+1.000,+0.000000E+00,+2.000000E-09A");
+  testOk( parseReadings( &port, buf, rd, 2) == -1,
+          "burst reply ending mid reading is refused");
+
+  port.settings.readingOnly = 1;
+  strcpy( buf, "+1.000000E-09A,+2.000000E-09A");
+  testOk( parseReadings( &port, buf, rd, 2) == 2,
+          "reading only burst of 2 parses");
+  testOk( near( rd[1].reading, 2e-9) && (rd[1].status == 0) &&
+          (rd[0].timestamp <= rd[1].timestamp),
+          "reading only burst stands in host times");
+  strcpy( buf, "+1.000000E-09A,+9.900000E+37A");
+  testOk( (parseReadings( &port, buf, rd, 2) == 2) && (rd[0].status == 0) &&
+          (rd[1].status == 1), "reading only burst overflow sets the bit");
+
+  for( i = 0, len = 0; i <= BURST_MAX; i++)
+    len += sprintf( buf + len, "%s+1.000000E-09A", i ? "," : "");
+  testOk( parseReadings( &port, buf, rd, BURST_MAX) == -1,
+          "burst longer than BURST_MAX is refused");
+
+  epicsMutexDestroy( port.lock);
+}
+
+
+/****************************************************************************
+ * Define dispatch tests through the mock port
+ ****************************************************************************/
+
+/* Connect an asynUser to tag on its address, NULL if create() refuses it */
+static asynUser *connectTag(Port *pport, const char *tag, int addr)
+{
+  asynUser *pasynUser;
+
+  pasynUser = pasynManager->createAsynUser( NULL, NULL);
+  if( (pasynManager->connectDevice( pasynUser, TEST_PORT, addr) !=
+       asynSuccess) ||
+      (create( pport, pasynUser, tag, NULL, NULL) != asynSuccess) )
+    {
+      pasynManager->freeAsynUser( pasynUser);
+      return NULL;
+    }
+
+  return pasynUser;
+}
+
+
+static void disconnectTag(asynUser *pasynUser)
+{
+  if( pasynUser == NULL)
+    return;
+  pasynManager->disconnect( pasynUser);
+  pasynManager->freeAsynUser( pasynUser);
+}
+
+
+static void testDispatch(void)
+{
+  Port *pport;
+  asynUser *pread, *prange, *pnplc, *pzero, *pstamp, *pbad;
+  epicsFloat64 fval;
+  epicsInt32 ival;
+  char buf[BUFFER_SIZE];
+  size_t nbytes;
+  asynStatus status;
+  int eom;
+
+  testOk( k648xMockPort( TEST_MOCK, TEST_SCRIPT, 0.0) == asynSuccess,
+          "mock port from %s", TEST_SCRIPT);
+  testOk( drvAsynKeithley648x( "6485", TEST_PORT, TEST_MOCK, 0, 0) == 0,
+          "driver initializes on the mock port");
+  pport = findPort( TEST_PORT, "k648xTest");
+  testOk( pport != NULL, "driver port found");
+  if( pport == NULL)
+    {
+      testSkip( 13, "no driver port");
+      return;
+    }
+  testOk( !strcmp( pport->serial, "1234567") &&
+          (strstr( pport->model, "6485") != NULL),
+          "identification parsed: %s, %s", pport->model, pport->serial);
+
+  pbad = connectTag( pport, "NO_SUCH_TAG", ADDR_DATA);
+  testOk( pbad == NULL, "unknown tag refused");
+  disconnectTag( pbad);
+  pbad = connectTag( pport, "RANGE", ADDR_DATA);
+  testOk( pbad != NULL, "configuration tag served on the data address");
+  disconnectTag( pbad);
+  pbad = connectTag( pport, "SWEEP_RUN", ADDR_CONFIG);
+  testOk( pbad == NULL, "6487 tag refused on a 6485");
+  disconnectTag( pbad);
+
+  pread = connectTag( pport, "READ", ADDR_DATA);
+  pstamp = connectTag( pport, "TIMESTAMP", ADDR_DATA);
+  prange = connectTag( pport, "RANGE", ADDR_CONFIG);
+  pnplc = connectTag( pport, "NPLC", ADDR_CONFIG);
+  pzero = connectTag( pport, "ZERO_CHECK", ADDR_CONFIG);
+  testOk( pread && pstamp && prange && pnplc && pzero, "tags created");
+  if( !(pread && pstamp && prange && pnplc && pzero) )
+    {
+      testSkip( 8, "tags missing");
+      return;
+    }
+
+  // the script cycles READ? through 1.00 nA at 1.0 s and 1.01 nA at 1.1 s
+  status = readFloat64( pport, pread, &fval);
+  testOk( (status == asynSuccess) && near( fval, 1e-9), 
+          "READ as Float64 %g", fval);
+  status = readInt32( pport, pstamp, &ival);
+  testOk( (status == asynSuccess) && (ival == 1), 
+          "TIMESTAMP from the reading cache %d", ival);
+  status = readOctet( pport, pread, buf, sizeof(buf), &nbytes, &eom);
+  testOk( (status == asynSuccess) && near( atof( buf), 1.01e-9),
+          "READ as Octet \"%s\"", buf);
+
+  status = readFloat64( pport, prange, &fval);
+  if( status == asynSuccess)
+    status = readInt32( pport, prange, &ival);
+  testOk( (status == asynSuccess) && near( fval, 2e-9) && (ival == 0),
+          "RANGE as Float64 %g and as Int32 index %d", fval, ival);
+
+  status = writeFloat64( pport, pnplc, 0.1);
+  if( status == asynSuccess)
+    status = readFloat64( pport, pnplc, &fval);
+  testOk( (status == asynSuccess) && near( fval, 0.1), 
+          "NPLC written and read back %g", fval);
+  status = writeInt32( pport, pzero, 1);
+  if( status == asynSuccess)
+    status = readInt32( pport, pzero, &ival);
+  testOk( (status == asynSuccess) && (ival == 1),
+          "ZERO_CHECK written and read back %d", ival);
+
+  disconnectTag( pread);
+  disconnectTag( pstamp);
+  disconnectTag( prange);
+  disconnectTag( pnplc);
+  disconnectTag( pzero);
+
+  // the timings are informational, the mock answers in this thread
+  testOk( drvAsynKeithley648xBench( TEST_PORT, "READ", "Float64", 10000) ==
+          asynSuccess, "READ benchmark");
+  testOk( drvAsynKeithley648xBench( TEST_PORT, "RANGE", "Int32", 10000) ==
+          asynSuccess, "RANGE benchmark");
+}
+
+
+
+
+MAIN(k648xTest)
+{
+  testPlan( 33);
+  testParseReading();
+  testParseReadings();
+  testDispatch();
+  return testDone();
+}